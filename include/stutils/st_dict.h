@@ -0,0 +1,292 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ST_DICT_H_
+#define _ST_DICT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <stutils/st_macro.h>
+#include "st_mem.h"
+
+#define ST_DICT_REALLOC_NUM 1000000
+
+/* alignment of node arrays, in memory and in saved files. */
+#define ST_DICT_ALIGN       64
+
+typedef unsigned int st_dict_sign_t;
+
+/*
+ * Build with _ST_DICT_64BIT_ID_ for dicts with more than 2^32 nodes. Dicts
+ * saved by one build can not be loaded by the other. Only the mixed hash
+ * functions, e.g. st_dict_hash_fmix64, spread nodes over more than 2^32
+ * buckets.
+ */
+#ifdef _ST_DICT_64BIT_ID_
+typedef uint64_t st_dict_id_t;
+#define ST_DICT_ID_FMT              "%"PRIu64
+#else
+typedef unsigned int st_dict_id_t;
+#define ST_DICT_ID_FMT              "%u"
+#endif
+#define ST_DICT_BAD_NODE            (st_dict_id_t)-1
+
+typedef struct _st_dict_node_t
+{
+    st_dict_sign_t sign1;
+    st_dict_sign_t sign2;
+    union
+    {
+        unsigned int uint1;
+        float        float1;
+    };
+    st_dict_id_t   next;
+} st_dict_node_t;
+
+struct _st_dict_t;
+typedef st_dict_id_t (*st_dict_hash_fun_t)(struct _st_dict_t *,
+    st_dict_node_t *);
+
+typedef bool (*st_dict_node_eq_fun_t)(st_dict_node_t *node1,
+    st_dict_node_t *node2, void *args);
+typedef int (*st_dict_update_func_t)(st_dict_node_t *node, float data);
+typedef int (*st_dict_trav_func_t)(st_dict_node_t *p, void *arg);
+
+/*
+ * Value stored inline after a node, for dicts created with value_size > 0.
+ */
+#define st_dict_node_value(node) ((void *)((st_dict_node_t *)(node) + 1))
+
+typedef enum _st_dict_engine_t_
+{
+    ST_DICT_ENGINE_CHAIN = 0, /* first_level_node chained through node_pool. */
+    ST_DICT_ENGINE_OPEN,      /* open addressing probed by groups of ctrl. */
+} st_dict_engine_t;
+
+/*
+ * Options for st_dict_create_ex. NULL means default values.
+ *
+ * With ST_DICT_ENGINE_OPEN, node_pool is not used: nodes are stored
+ * directly in first_level_node, with one control byte per slot in ctrl,
+ * and the table doubles itself when it is 7/8 full. The control byte keeps
+ * 7 bits of a hash of sign1/sign2, so node_eq_func must never match two
+ * nodes with different signs.
+ *
+ * With max_load_factor > 0, a chained dict doubles first_level_node once
+ * node_num / hash_num exceeds it, migrating a few buckets on each insertion.
+ * This needs a hash_func of the form f(node) & addr_mask, as the built-in
+ * ones are, and can not be used together with need_clear.
+ *
+ * With concurrent, st_dict_seek may be called from any number of threads
+ * without locking, while a single thread adds or updates nodes. Only
+ * chained dicts without need_clear or max_load_factor support it. The
+ * node_pools replaced by growth are freed by st_dict_reclaim, which must
+ * only be called when no reader is inside st_dict_seek, or by destroy.
+ *
+ * With value_size > 0, every node carries value_size bytes right after it,
+ * see st_dict_node_value. Nodes are then padded to a power of 2 up to a
+ * cache line, or to whole cache lines, and the arrays are aligned to a
+ * cache line, so that a lookup touches a single line for small values.
+ * The nodes passed to add, seek, update and delete must be followed by
+ * value_size bytes too: they are copied in on insertion and copied out
+ * when found.
+ */
+typedef struct _st_dict_opt_t_
+{
+    st_dict_engine_t engine;
+    float max_load_factor; /* 0 to keep hash_num fixed. */
+    bool concurrent;
+    size_t value_size; /* bytes of value in each node, 0 for none. */
+} st_dict_opt_t;
+
+typedef struct _st_dict_t
+{
+    st_dict_node_t     *first_level_node;
+    st_dict_id_t       hash_num;
+    st_dict_id_t       realloc_node_num;
+
+    st_dict_node_t     *node_pool;
+    st_dict_id_t       cur_index;
+    st_dict_id_t       max_pool_num;
+    st_dict_id_t       free_head; /* deleted node_pool slots, chained by next. */
+
+    st_dict_id_t       node_num;
+
+    st_dict_id_t       addr_mask;
+    st_dict_hash_fun_t hash_func;
+    st_dict_node_eq_fun_t node_eq_func;
+
+    size_t             value_size;
+    size_t             node_size; /* stride of node arrays. */
+
+    st_dict_id_t       *clear_nodes;
+    st_dict_id_t       clear_node_num;
+
+    st_dict_engine_t   engine;
+    unsigned char      *ctrl; /* control bytes for ST_DICT_ENGINE_OPEN. */
+    st_dict_id_t       deleted_num; /* ctrls marked deleted. */
+
+    float              max_load_factor;
+    st_dict_node_t     *old_first_level_node; /* table being rehashed. */
+    st_dict_id_t       old_hash_num;
+    st_dict_id_t       old_addr_mask;
+    st_dict_id_t       rehash_idx; /* old buckets below it are migrated. */
+
+    bool               concurrent;
+    st_dict_node_t     **retired_pools; /* node_pools readers may still use. */
+    int                retired_num;
+
+    bool               read_only; /* nodes point into a saved image. */
+    void               *map_addr;
+    size_t             map_len;
+} st_dict_t;
+
+st_dict_t* st_dict_create(st_dict_id_t hash_num,
+    st_dict_id_t realloc_node_num, st_dict_hash_fun_t hash_func,
+    st_dict_node_eq_fun_t node_eq_func, bool need_clear);
+
+st_dict_t* st_dict_create_ex(st_dict_id_t hash_num,
+    st_dict_id_t realloc_node_num, st_dict_hash_fun_t hash_func,
+    st_dict_node_eq_fun_t node_eq_func, bool need_clear,
+    const st_dict_opt_t *opt);
+
+#define safe_st_dict_destroy(ptr) do {\
+    if((ptr) != NULL) {\
+        st_dict_destroy(ptr);\
+        safe_st_free(ptr);\
+        (ptr) = NULL;\
+    }\
+    } while(0)
+void st_dict_destroy(st_dict_t *wd);
+
+int st_dict_add(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg);
+int st_dict_add_no_seek(st_dict_t *wd, st_dict_node_t *pnode);
+int st_dict_seek(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg);
+
+/*
+ * Return the stored node equal to pnode, NULL if not found. The node and
+ * its value may be modified in place, except for the signs.
+ */
+st_dict_node_t* st_dict_find(st_dict_t *wd, st_dict_node_t *pnode,
+        void *node_eq_arg);
+
+/*
+ * Seek n nodes at once. rets[i] is set to 0 and nodes[i].uint1 is filled if
+ * nodes[i] is found, otherwise rets[i] is -1. node_eq_args may be NULL, or
+ * hold one node_eq_arg per node. Buckets and chain nodes of a group of keys
+ * are prefetched together, which hides most of the cache misses on large
+ * dicts. With value_size > 0, nodes are wd->node_size apart. Returns the
+ * number of nodes found, -1 on error.
+ */
+int st_dict_seek_batch(st_dict_t *wd, st_dict_node_t *nodes, int n,
+        void **node_eq_args, int *rets);
+
+/*
+ * Remove the node equal to pnode, whose uint1 is set to the removed value.
+ * Returns -1 if no such node exists. Not allowed in concurrent mode.
+ *
+ * Pooled nodes are recycled by later insertions. With need_clear, deleting
+ * the last node of a chained bucket costs a scan of the buckets to clear.
+ */
+int st_dict_delete(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg);
+
+int st_dict_traverse(st_dict_t *wd, st_dict_trav_func_t trav, void *args);
+/*
+ * Traverse with nthreads threads, each one visiting a range of buckets.
+ * trav is called from all the threads at once. Nodes must not be added or
+ * deleted meanwhile.
+ */
+int st_dict_traverse_parallel(st_dict_t *wd, int nthreads,
+        st_dict_trav_func_t trav, void *args);
+
+/*
+ * Add n nodes at once, using nthreads threads for chained dicts. Nodes
+ * already in the dict, or repeated in nodes, are skipped, as if
+ * st_dict_add was called for every node with node_eq_arg NULL. With
+ * value_size > 0, nodes are wd->node_size apart. Open addressing dicts are
+ * built by the calling thread. Returns the number of nodes added,
+ * ST_DICT_BAD_NODE on error.
+ */
+st_dict_id_t st_dict_build_bulk(st_dict_t *wd, st_dict_node_t *nodes,
+        st_dict_id_t n, int nthreads);
+
+int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args);
+
+int st_dict_update(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg,
+        st_dict_update_func_t update_data);
+
+int st_dict_reclaim(st_dict_t *wd);
+
+int st_dict_save(st_dict_t *wd, FILE *fp);
+
+st_dict_t* st_dict_load_from_bin(FILE *fp);
+
+/*
+ * Map a file written by st_dict_save read-only, and serve it in place. The
+ * returned dict can only be seeked and traversed.
+ */
+st_dict_t* st_dict_mmap(const char *file);
+
+/*
+ * Same as st_dict_mmap, for a dict saved at some offset of a larger image
+ * already in memory. buf must be aligned to ST_DICT_ALIGN and outlive the
+ * returned dict.
+ */
+st_dict_t* st_dict_map_buf(const void *buf, size_t len);
+
+st_dict_id_t st_dict_hash_simple(st_dict_t *wd, st_dict_node_t *pnode);
+st_dict_id_t st_dict_hash_sign1l16(st_dict_t *wd, st_dict_node_t *pnode);
+st_dict_id_t st_dict_hash_sign1(st_dict_t *wd, st_dict_node_t *pnode);
+
+/*
+ * Hashes mixing all the 64 bits of sign1 and sign2, for signatures whose
+ * bits are not uniformly distributed. st_dict_hash_fmix64 is the default
+ * of ST_DICT_ENGINE_OPEN.
+ */
+st_dict_id_t st_dict_hash_fmix64(st_dict_t *wd, st_dict_node_t *pnode);
+st_dict_id_t st_dict_hash_xxh3(st_dict_t *wd, st_dict_node_t *pnode);
+st_dict_id_t st_dict_hash_wyhash(st_dict_t *wd, st_dict_node_t *pnode);
+
+/*
+ * Histogram of chain lengths: hist[i] is the number of buckets holding i
+ * nodes, the last one also counting longer chains. For open addressing
+ * dicts, hist[i] is the number of nodes found i groups away from their
+ * first probe. Returns the longest chain or distance, ST_DICT_BAD_NODE on
+ * error.
+ */
+st_dict_id_t st_dict_chain_hist(st_dict_t *wd, st_dict_id_t *hist, int n);
+
+st_dict_t* st_dict_dup(st_dict_t *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2015 Wang Jian
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ST_NET_H_
+#define _ST_NET_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#define ST_NET_INTERNEL_ERROR     -1
+#define ST_NET_CONNECT_TIMEOUT    -2
+#define ST_NET_SND_RCV_TIMEOUT    -3
+#define ST_NET_NETWORK            -4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int st_listen(int port, int queue);
+
+int st_connect(const char* addr, short port, int *tmo);
+
+int st_read(int fd, int *tmo, void* buf, size_t len);
+
+int st_write(int fd, int *tmo, void* buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ST_TRIE_H__
+#define _ST_TRIE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <stutils/st_macro.h>
+#include "st_alphabet.h"
+
+/*
+ * Double-array trie over the labels of an alphabet.
+ *
+ * The child of node s on byte c is t = units[s].base + c + 1, valid if
+ * units[t].check == s. The end of a label is a child on code 0, whose base
+ * holds -(id + 1). The root is node 0.
+ */
+typedef struct _st_trie_unit_t
+{
+    int32_t base;
+    int32_t check; /* parent, -1 for free units. */
+} st_trie_unit_t;
+
+typedef struct _st_trie_t
+{
+    st_trie_unit_t *units;
+    int size;
+    int label_num;
+
+    void *map_addr; /* units point into a mapped file. */
+    size_t map_len;
+} st_trie_t;
+
+/*
+ * Build a trie with every label of alphabet. Labels repeated under
+ * different ids keep the smallest one.
+ */
+st_trie_t* st_trie_build(st_alphabet_t *alphabet);
+
+#define safe_st_trie_destroy(ptr) do {\
+    if((ptr) != NULL) {\
+        st_trie_destroy(ptr);\
+        safe_st_free(ptr);\
+        (ptr) = NULL;\
+    }\
+    } while(0)
+
+void st_trie_destroy(st_trie_t *trie);
+
+/*
+ * Id of the label equal to the len bytes of key, -1 if none.
+ */
+int st_trie_find(st_trie_t *trie, const char *key, size_t len);
+
+/*
+ * Id of the longest label which is a prefix of the len bytes of buf, -1 if
+ * none. match_len, if not NULL, is set to the length of the label.
+ */
+int st_trie_longest_match(st_trie_t *trie, const char *buf, size_t len,
+        int *match_len);
+
+/*
+ * Ids and lengths of all labels which are prefixes of buf, shortest first.
+ * lens may be NULL. Returns the number of labels found, at most max_num,
+ * -1 on error.
+ */
+int st_trie_common_prefix(st_trie_t *trie, const char *buf, size_t len,
+        int *ids, int *lens, int max_num);
+
+typedef int (*st_trie_enum_func_t)(int id, void *args);
+
+/*
+ * Call func on every label starting with the len bytes of prefix, in byte
+ * order. Stops with an error if func returns a negative value. Returns the
+ * number of labels, -1 on error.
+ */
+int st_trie_enumerate(st_trie_t *trie, const char *prefix, size_t len,
+        st_trie_enum_func_t func, void *args);
+
+/*
+ * Save after st_alphabet_save_bin to keep a trie next to its alphabet, and
+ * load them back in the same order.
+ */
+int st_trie_save(st_trie_t *trie, FILE *fp);
+
+st_trie_t* st_trie_load_from_bin(FILE *fp);
+
+/*
+ * Map a file written by st_trie_save read-only, and use it in place.
+ */
+st_trie_t* st_trie_mmap(const char *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
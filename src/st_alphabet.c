@@ -23,6 +23,12 @@
  */
 
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "st_utils.h"
 #include "st_log.h"
@@ -47,15 +53,372 @@ void get_sign(const char *psrc, int slen, st_dict_sign_t *sign1, st_dict_sign_t
     }
 }
 
+#define st_alphabet_label_at(alphabet, off) \
+    ((alphabet)->label_chunks[(off) >> ST_ALPHABET_CHUNK_SHIFT] \
+     + ((off) & (ST_ALPHABET_CHUNK_SIZE - 1)))
+
+#define ST_ALPHABET_BATCH 64
+
+/*
+ * label_offs doubles from ST_ALPHABET_INIT_NUM when full, and index_dict
+ * rehashes past ST_ALPHABET_MAX_LOAD_FACTOR nodes per bucket, so memory
+ * follows the number of labels actually added.
+ */
+#define ST_ALPHABET_INIT_NUM        1024
+#define ST_ALPHABET_MAX_LOAD_FACTOR 1.0f
+
+/*
+ * Minimal perfect hash.
+ *
+ * Buckets are placed from the largest one, each trying pilots until all
+ * its labels land in free slots. With ST_ALPHABET_MPH_LAMBDA labels per
+ * bucket and 1/64 spare slots, 16-bit pilots almost always suffice;
+ * otherwise another seed is tried.
+ */
+#define ST_ALPHABET_MPH_LAMBDA  4
+#define ST_ALPHABET_MPH_TRIES   8
+
+// finalizer of MurmurHash3
+static uint64_t st_alphabet_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+// map h into [0, n) without division
+#define st_alphabet_range(h, n) \
+    ((uint32_t)(((unsigned __int128)(h) * (n)) >> 64))
+
+// len is at most MAX_SYM_LEN - 1, as labels are stored
+static uint64_t st_alphabet_label_hash(const char *label, size_t len,
+        uint64_t seed)
+{
+    return MurmurHash64A(label, (int)len, seed);
+}
+
+// whether the label of id is the len bytes at label
+static bool st_alphabet_label_eq(st_alphabet_t *alphabet, int id,
+        const char *label, size_t len)
+{
+    const char *stored;
+
+    stored = st_alphabet_label_at(alphabet, alphabet->label_offs[id]);
+
+    return strncmp(stored, label, len) == 0 && stored[len] == 0;
+}
+
+static uint32_t st_alphabet_mph_slot(st_alphabet_mph_t *mph, uint64_t h,
+        uint16_t pilot)
+{
+    return st_alphabet_range(st_alphabet_mix(h
+                ^ st_alphabet_mix(mph->seed + pilot)), mph->table_size);
+}
+
+static void st_alphabet_mph_destroy(st_alphabet_mph_t *mph)
+{
+    if (mph == NULL) {
+        return;
+    }
+
+    if (!mph->mapped) {
+        safe_st_free(mph->pilots);
+        safe_st_free(mph->remap);
+        safe_st_free(mph->ids);
+    }
+    mph->pilots = NULL;
+    mph->remap = NULL;
+    mph->ids = NULL;
+}
+
+#define safe_st_alphabet_mph_destroy(ptr) do {\
+    if((ptr) != NULL) {\
+        st_alphabet_mph_destroy(ptr);\
+        safe_st_free(ptr);\
+        (ptr) = NULL;\
+    }\
+    } while(0)
+
+static st_alphabet_mph_t* st_alphabet_mph_alloc(uint64_t seed,
+        uint32_t bucket_num, uint32_t table_size)
+{
+    st_alphabet_mph_t *mph;
+
+    mph = (st_alphabet_mph_t *)st_malloc(sizeof(st_alphabet_mph_t));
+    if (mph == NULL) {
+        ST_ERROR("Failed to st_malloc mph.");
+        return NULL;
+    }
+    memset(mph, 0, sizeof(st_alphabet_mph_t));
+    mph->seed = seed;
+    mph->bucket_num = bucket_num;
+    mph->table_size = table_size;
+
+    return mph;
+}
+
+static uint32_t st_alphabet_mph_id(st_alphabet_t *alphabet, uint64_t h)
+{
+    st_alphabet_mph_t *mph;
+    uint32_t slot;
+
+    mph = alphabet->mph;
+    slot = st_alphabet_mph_slot(mph, h,
+            mph->pilots[st_alphabet_range(h, mph->bucket_num)]);
+    if (slot >= alphabet->label_num) {
+        slot = mph->remap[slot - alphabet->label_num];
+    }
+
+    return mph->ids[slot];
+}
+
+static int st_alphabet_mph_find(st_alphabet_t *alphabet, const char *label,
+        size_t len)
+{
+    uint32_t id;
+
+    len = min(len, (size_t)(MAX_SYM_LEN - 1));
+    id = st_alphabet_mph_id(alphabet, st_alphabet_label_hash(label, len,
+                alphabet->mph->seed));
+    if (!st_alphabet_label_eq(alphabet, (int)id, label, len)) {
+        return -1;
+    }
+
+    return (int)id;
+}
+
+#define st_alphabet_bit_test(bits, i) (((bits)[(i) >> 6] >> ((i) & 63)) & 1)
+#define st_alphabet_bit_set(bits, i) ((bits)[(i) >> 6] |= 1ULL << ((i) & 63))
+
+// returns 1 if some bucket found no pilot with this seed
+static int st_alphabet_mph_build(st_alphabet_t *alphabet, uint64_t seed,
+        st_alphabet_mph_t **pmph)
+{
+    st_alphabet_mph_t *mph = NULL;
+    uint64_t *hashes = NULL;
+    uint64_t *taken = NULL;
+    uint32_t *starts = NULL;
+    uint32_t *keys = NULL;
+    uint32_t *order = NULL;
+    uint32_t *slots = NULL;
+    uint32_t pos[64];
+    const char *label;
+    uint32_t n, b, i, j, k, p, f;
+    uint32_t size, max_size;
+    uint32_t pilot;
+    int ret = -1;
+
+    n = (uint32_t)alphabet->label_num;
+    mph = st_alphabet_mph_alloc(seed,
+            (n + ST_ALPHABET_MPH_LAMBDA - 1) / ST_ALPHABET_MPH_LAMBDA,
+            n + n / 64 + 1);
+    if (mph == NULL) {
+        ST_ERROR("Failed to st_alphabet_mph_alloc.");
+        goto ERR;
+    }
+
+    hashes = (uint64_t *)st_malloc(sizeof(uint64_t) * n);
+    starts = (uint32_t *)st_malloc(sizeof(uint32_t) * (mph->bucket_num + 1));
+    keys = (uint32_t *)st_malloc(sizeof(uint32_t) * n);
+    order = (uint32_t *)st_malloc(sizeof(uint32_t) * mph->bucket_num);
+    slots = (uint32_t *)st_malloc(sizeof(uint32_t) * mph->table_size);
+    taken = (uint64_t *)st_malloc(sizeof(uint64_t)
+            * ((mph->table_size + 63) / 64));
+    mph->pilots = (uint16_t *)st_malloc(sizeof(uint16_t) * mph->bucket_num);
+    if (hashes == NULL || starts == NULL || keys == NULL || order == NULL
+            || slots == NULL || taken == NULL || mph->pilots == NULL) {
+        ST_ERROR("Failed to st_malloc mph buffers.");
+        goto ERR;
+    }
+    memset(starts, 0, sizeof(uint32_t) * (mph->bucket_num + 1));
+    memset(taken, 0, sizeof(uint64_t) * ((mph->table_size + 63) / 64));
+    memset(mph->pilots, 0, sizeof(uint16_t) * mph->bucket_num);
+
+    // group labels by bucket
+    for (i = 0; i < n; i++) {
+        label = st_alphabet_label_at(alphabet, alphabet->label_offs[i]);
+        hashes[i] = st_alphabet_label_hash(label, strlen(label), seed);
+        starts[st_alphabet_range(hashes[i], mph->bucket_num) + 1]++;
+    }
+    max_size = 0;
+    for (b = 0; b < mph->bucket_num; b++) {
+        max_size = max(max_size, starts[b + 1]);
+        starts[b + 1] += starts[b];
+    }
+    if (max_size > sizeof(pos) / sizeof(pos[0])) {
+        ret = 1;
+        goto ERR;
+    }
+    for (i = 0; i < n; i++) {
+        b = st_alphabet_range(hashes[i], mph->bucket_num);
+        keys[starts[b]++] = i;
+    }
+    for (b = mph->bucket_num; b > 0; b--) {
+        starts[b] = starts[b - 1];
+    }
+    starts[0] = 0;
+
+    // largest buckets first
+    k = 0;
+    for (size = max_size; size > 0; size--) {
+        for (b = 0; b < mph->bucket_num; b++) {
+            if (starts[b + 1] - starts[b] == size) {
+                order[k++] = b;
+            }
+        }
+    }
+
+    for (i = 0; i < k; i++) {
+        b = order[i];
+        size = starts[b + 1] - starts[b];
+        for (pilot = 0; pilot <= UINT16_MAX; pilot++) {
+            for (j = 0; j < size; j++) {
+                pos[j] = st_alphabet_mph_slot(mph,
+                        hashes[keys[starts[b] + j]], (uint16_t)pilot);
+                if (st_alphabet_bit_test(taken, pos[j])) {
+                    break;
+                }
+                for (p = 0; p < j && pos[p] != pos[j]; p++);
+                if (p < j) {
+                    break;
+                }
+            }
+            if (j == size) {
+                break;
+            }
+        }
+        if (pilot > UINT16_MAX) {
+            ret = 1;
+            goto ERR;
+        }
+
+        mph->pilots[b] = (uint16_t)pilot;
+        for (j = 0; j < size; j++) {
+            st_alphabet_bit_set(taken, pos[j]);
+            slots[pos[j]] = keys[starts[b] + j];
+        }
+    }
+
+    // move labels in spare slots to the holes below n
+    mph->remap = (uint32_t *)st_malloc(sizeof(uint32_t)
+            * (mph->table_size - n));
+    if (mph->remap == NULL) {
+        ST_ERROR("Failed to st_malloc remap.");
+        goto ERR;
+    }
+    f = 0;
+    for (p = n; p < mph->table_size; p++) {
+        mph->remap[p - n] = 0;
+        if (!st_alphabet_bit_test(taken, p)) {
+            continue;
+        }
+        while (st_alphabet_bit_test(taken, f)) {
+            f++;
+        }
+        mph->remap[p - n] = f;
+        slots[f] = slots[p];
+        f++;
+    }
+    mph->ids = slots;
+    slots = NULL;
+
+    safe_st_free(hashes);
+    safe_st_free(starts);
+    safe_st_free(keys);
+    safe_st_free(order);
+    safe_st_free(taken);
+
+    *pmph = mph;
+    return 0;
+
+ERR:
+    safe_st_free(hashes);
+    safe_st_free(starts);
+    safe_st_free(keys);
+    safe_st_free(order);
+    safe_st_free(slots);
+    safe_st_free(taken);
+    safe_st_alphabet_mph_destroy(mph);
+    return ret;
+}
+
+int st_alphabet_freeze(st_alphabet_t *alphabet)
+{
+    st_alphabet_mph_t *mph = NULL;
+    int ret;
+    int t;
+
+    ST_CHECK_PARAM(alphabet == NULL || alphabet->label_num <= 0, -1);
+
+    if (alphabet->mph != NULL) {
+        return 0;
+    }
+
+    for (t = 0; t < ST_ALPHABET_MPH_TRIES; t++) {
+        ret = st_alphabet_mph_build(alphabet, st_alphabet_mix(t + 1), &mph);
+        if (ret < 0) {
+            ST_ERROR("Failed to st_alphabet_mph_build.");
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+    }
+
+    if (mph == NULL) {
+        ST_ERROR("No perfect hash found, duplicated labels?");
+        return -1;
+    }
+
+    alphabet->mph = mph;
+    alphabet->max_label_num = alphabet->label_num;
+    safe_st_dict_destroy(alphabet->index_dict);
+
+    return 0;
+}
+
 void st_alphabet_destroy(st_alphabet_t *alphabet)
 {
+    int i;
+
     if (alphabet == NULL) {
         return;
     }
 
-    safe_st_free(alphabet->labels);
+    if (alphabet->label_chunks != NULL) {
+        if (alphabet->map_addr == NULL) {
+            for (i = 0; i < alphabet->chunk_num; i++) {
+                safe_st_free(alphabet->label_chunks[i]);
+            }
+        }
+        safe_st_free(alphabet->label_chunks);
+    }
+    alphabet->chunk_num = 0;
+    alphabet->max_chunk_num = 0;
+    alphabet->pool_size = 0;
+
+    if (alphabet->map_addr == NULL) {
+        safe_st_free(alphabet->label_offs);
+    }
+    alphabet->label_offs = NULL;
 
     safe_st_dict_destroy(alphabet->index_dict);
+    safe_st_alphabet_mph_destroy(alphabet->mph);
+
+    if (alphabet->concurrent) {
+        (void)pthread_mutex_destroy(&alphabet->add_lock);
+        alphabet->concurrent = false;
+    }
+
+    if (alphabet->map_addr != NULL) {
+        (void)munmap(alphabet->map_addr, alphabet->map_len);
+        alphabet->map_addr = NULL;
+        alphabet->map_len = 0;
+    }
 }
 
 static st_alphabet_t* st_alphabet_alloc()
@@ -68,16 +431,150 @@ static st_alphabet_t* st_alphabet_alloc()
         return NULL;
     }
 
-    alphabet->labels = NULL;
+    alphabet->label_chunks = NULL;
+    alphabet->chunk_num = 0;
+    alphabet->max_chunk_num = 0;
+    alphabet->pool_size = 0;
+    alphabet->label_offs = NULL;
+    alphabet->max_label_num = 0;
     alphabet->label_num = 0;
     alphabet->index_dict = NULL;
+    alphabet->mph = NULL;
+    alphabet->map_addr = NULL;
+    alphabet->map_len = 0;
+    alphabet->concurrent = false;
 
     return alphabet;
 }
 
+// enable concurrent adds, the chunk table is sized for max_label_num
+static int st_alphabet_set_concurrent(st_alphabet_t *alphabet)
+{
+    char **chunks;
+    int num;
+
+    // labels never straddle chunks, so less than one label is wasted
+    num = alphabet->max_label_num
+        / (ST_ALPHABET_CHUNK_SIZE / MAX_SYM_LEN - 1) + 1;
+    if (num > alphabet->max_chunk_num) {
+        chunks = (char **)st_realloc(alphabet->label_chunks,
+                sizeof(char *) * num);
+        if (chunks == NULL) {
+            ST_ERROR("Failed to st_realloc label_chunks. [%d]", num);
+            return -1;
+        }
+        alphabet->label_chunks = chunks;
+        alphabet->max_chunk_num = num;
+    }
+
+    if (pthread_mutex_init(&alphabet->add_lock, NULL) != 0) {
+        ST_ERROR("Failed to pthread_mutex_init.");
+        return -1;
+    }
+    alphabet->concurrent = true;
+
+    return 0;
+}
+
+// allocate or grow label_offs to num entries
+static int st_alphabet_alloc_offs(st_alphabet_t *alphabet, int num)
+{
+    uint64_t *offs;
+    int i;
+
+    offs = (uint64_t *)st_realloc(alphabet->label_offs,
+            sizeof(uint64_t) * max(num, 1));
+    if (offs == NULL) {
+        ST_ERROR("Failed to st_realloc label_offs. [%d]", num);
+        return -1;
+    }
+
+    for (i = alphabet->max_label_num; i < num; i++) {
+        offs[i] = ST_ALPHABET_NO_LABEL;
+    }
+    alphabet->label_offs = offs;
+    alphabet->max_label_num = num;
+
+    return 0;
+}
+
+static st_dict_t* st_alphabet_create_index_dict(int label_num,
+        st_dict_node_eq_fun_t node_eq_func, bool concurrent)
+{
+    st_dict_opt_t dict_opt;
+
+    // a concurrent dict can not rehash, otherwise it grows with the labels
+    dict_opt.engine = ST_DICT_ENGINE_CHAIN;
+    dict_opt.max_load_factor = concurrent ? 0 : ST_ALPHABET_MAX_LOAD_FACTOR;
+    dict_opt.concurrent = concurrent;
+    dict_opt.value_size = 0;
+
+    return st_dict_create_ex((int)(max(label_num, 1) * 1.5),
+            ST_DICT_REALLOC_NUM, NULL, node_eq_func, false, &dict_opt);
+}
+
+// copy label into the arena as the label of id
+static int st_alphabet_put_label_len(st_alphabet_t *alphabet, int id,
+        const char *label, size_t len)
+{
+    char **chunks;
+    char *chunk;
+    int num;
+
+    len = min(len, (size_t)(MAX_SYM_LEN - 1));
+    if (alphabet->pool_size + len + 1
+            > ((uint64_t)alphabet->chunk_num << ST_ALPHABET_CHUNK_SHIFT)) {
+        // readers may be using label_chunks in concurrent mode
+        if (alphabet->chunk_num >= alphabet->max_chunk_num
+                && alphabet->concurrent) {
+            ST_ERROR("label_chunks overflow[%d].", alphabet->chunk_num);
+            return -1;
+        }
+        if (alphabet->chunk_num >= alphabet->max_chunk_num) {
+            num = max(alphabet->max_chunk_num * 2, 16);
+            chunks = (char **)st_realloc(alphabet->label_chunks,
+                    sizeof(char *) * num);
+            if (chunks == NULL) {
+                ST_ERROR("Failed to st_realloc label_chunks. [%d]", num);
+                return -1;
+            }
+            alphabet->label_chunks = chunks;
+            alphabet->max_chunk_num = num;
+        }
+
+        chunk = (char *)st_malloc(ST_ALPHABET_CHUNK_SIZE);
+        if (chunk == NULL) {
+            ST_ERROR("Failed to st_malloc label chunk.");
+            return -1;
+        }
+        bzero(chunk, ST_ALPHABET_CHUNK_SIZE);
+        // the tail of the last chunk is left unused
+        alphabet->label_chunks[alphabet->chunk_num] = chunk;
+        alphabet->pool_size = (uint64_t)alphabet->chunk_num
+            << ST_ALPHABET_CHUNK_SHIFT;
+        alphabet->chunk_num++;
+    }
+
+    chunk = st_alphabet_label_at(alphabet, alphabet->pool_size);
+    memcpy(chunk, label, len);
+    chunk[len] = 0;
+    alphabet->label_offs[id] = alphabet->pool_size;
+    alphabet->pool_size += len + 1;
+
+    return 0;
+}
+
+static int st_alphabet_put_label(st_alphabet_t *alphabet, int id,
+        const char *label)
+{
+    return st_alphabet_put_label_len(alphabet, id, label,
+            strnlen(label, MAX_SYM_LEN - 1));
+}
+
 typedef struct _index_dict_eq_args_t_ {
     st_alphabet_t *alphabet;
     const char *label;
+    size_t len; /* label may not be NUL terminated. */
 } index_dict_eq_args_t;
 
 static bool index_dict_node_eq(st_dict_node_t *node1,
@@ -98,20 +595,33 @@ static bool index_dict_node_eq(st_dict_node_t *node1,
         return false;
     }
 
-    if (node1->uint1 >= alphabet->label_num) {
+    if (node1->uint1 >= __atomic_load_n(&alphabet->label_num,
+                __ATOMIC_ACQUIRE)) {
         ST_ERROR("node->uint1 overflow[%u/%u].", node1->uint1, alphabet->label_num);
         return false;
     }
 
-    return (strncmp(alphabet->labels[node1->uint1].label, arg->label, MAX_SYM_LEN) == 0);
+    return st_alphabet_label_eq(alphabet, node1->uint1, arg->label, arg->len);
 }
 
 st_alphabet_t* st_alphabet_create(int max_label_num)
+{
+    return st_alphabet_create_ex(max_label_num, NULL);
+}
+
+st_alphabet_t* st_alphabet_create_ex(int max_label_num,
+        const st_alphabet_opt_t *opt)
 {
     st_alphabet_t *alphabet = NULL;
-    int i;
+    bool concurrent;
+
+    concurrent = (opt != NULL && opt->concurrent);
+    ST_CHECK_PARAM(max_label_num < 0 || (concurrent && max_label_num == 0),
+            NULL);
 
-    ST_CHECK_PARAM(max_label_num <= 0, NULL);
+    if (max_label_num == 0) {
+        max_label_num = ST_ALPHABET_INIT_NUM;
+    }
 
     alphabet = st_alphabet_alloc();
     if (alphabet == NULL) {
@@ -119,25 +629,24 @@ st_alphabet_t* st_alphabet_create(int max_label_num)
         goto ERR;
     }
 
-    alphabet->max_label_num = max_label_num;
-    alphabet->labels = (st_label_t *)
-        st_malloc(max_label_num * sizeof(st_label_t));
-    if (alphabet->labels == NULL) {
-        ST_ERROR("Failed to allocate memory for labels.");
+    if (st_alphabet_alloc_offs(alphabet, max_label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
         goto ERR;
     }
 
-    for(i = 0; i < max_label_num; i++) {
-        alphabet->labels[i].symid = -1;
-        alphabet->labels[i].label[0] = 0;
-    }
-
-    if ((alphabet->index_dict = st_dict_create((int)(max_label_num * 1.5),
-        ST_DICT_REALLOC_NUM, NULL, index_dict_node_eq, false)) == NULL) {
+    if ((alphabet->index_dict = st_alphabet_create_index_dict(max_label_num,
+                    index_dict_node_eq, concurrent)) == NULL) {
         ST_ERROR("Failed to alloc index_dict");
         goto ERR;
     }
 
+    if (concurrent) {
+        if (st_alphabet_set_concurrent(alphabet) < 0) {
+            ST_ERROR("Failed to st_alphabet_set_concurrent.");
+            goto ERR;
+        }
+    }
+
     return alphabet;
 
 ERR:
@@ -145,52 +654,92 @@ ERR:
     return NULL;
 }
 
-int st_alphabet_add_label(st_alphabet_t *alphabet, const char *label_)
+// insert a label known to be absent
+static int st_alphabet_insert_label(st_alphabet_t *alphabet,
+        const char *label_)
 {
     st_dict_node_t snode;
-    int ret = 0;
+    int id;
 
-    ret = st_alphabet_get_index(alphabet, label_);
-    if (ret >= 0) {
-        return ret;
+    if (alphabet->map_addr != NULL || alphabet->mph != NULL) {
+        ST_ERROR("Can not add label[%s] to a mapped or frozen alphabet.",
+                label_);
+        return -1;
     }
 
     if (alphabet->max_label_num <= alphabet->label_num) {
-        ST_ERROR("label overflow[%d/%d]", alphabet->label_num,
-                alphabet->max_label_num);
+        // readers may be using label_offs in concurrent mode
+        if (alphabet->concurrent || alphabet->max_label_num > INT_MAX / 2) {
+            ST_ERROR("label overflow[%d/%d]", alphabet->label_num,
+                    alphabet->max_label_num);
+            return -1;
+        }
+        if (st_alphabet_alloc_offs(alphabet, max(alphabet->max_label_num * 2,
+                        ST_ALPHABET_INIT_NUM)) < 0) {
+            ST_ERROR("Failed to st_alphabet_alloc_offs.");
+            return -1;
+        }
+    }
+
+    id = alphabet->label_num;
+    if (st_alphabet_put_label(alphabet, id, label_) < 0) {
+        ST_ERROR("Failed to st_alphabet_put_label.");
         return -1;
     }
 
-    alphabet->labels[alphabet->label_num].symid = alphabet->label_num;
-    strncpy(alphabet->labels[alphabet->label_num].label, label_, MAX_SYM_LEN);
-    alphabet->labels[alphabet->label_num].label[MAX_SYM_LEN - 1] = 0;
+    // the label must be readable before its node is found in index_dict
+    __atomic_store_n(&alphabet->label_num, id + 1, __ATOMIC_RELEASE);
 
     get_sign((char *)label_, strlen(label_), &snode.sign1, &snode.sign2);
-    snode.uint1 = alphabet->label_num;
+    snode.uint1 = id;
 
     if (st_dict_add_no_seek(alphabet->index_dict, &snode) < 0) {
         ST_ERROR("Failed to add label[%s] into dict", label_);
+        __atomic_store_n(&alphabet->label_num, id, __ATOMIC_RELEASE);
         return -1;
     }
 
-    alphabet->label_num++;
-    return alphabet->label_num - 1;
+    return id;
+}
+
+int st_alphabet_add_label(st_alphabet_t *alphabet, const char *label_)
+{
+    int ret = 0;
+
+    ret = st_alphabet_get_index(alphabet, label_);
+    if (ret >= 0) {
+        return ret;
+    }
+
+    if (!alphabet->concurrent) {
+        return st_alphabet_insert_label(alphabet, label_);
+    }
+
+    (void)pthread_mutex_lock(&alphabet->add_lock);
+    // another thread may have added it meanwhile
+    ret = st_alphabet_get_index(alphabet, label_);
+    if (ret < 0) {
+        ret = st_alphabet_insert_label(alphabet, label_);
+    }
+    (void)pthread_mutex_unlock(&alphabet->add_lock);
+
+    return ret;
 }
 
 int st_alphabet_get_label_num(st_alphabet_t *alphabet)
 {
     ST_CHECK_PARAM(alphabet == NULL, -1);
 
-    return alphabet->label_num;
+    return __atomic_load_n(&alphabet->label_num, __ATOMIC_ACQUIRE);
 }
 
 char *st_alphabet_get_label(st_alphabet_t *alphabet, int index)
 {
     ST_CHECK_PARAM_EX(alphabet == NULL || index < 0
-        || index > alphabet->label_num, NULL, "%d/%d", index,
-        alphabet->label_num);
+        || index >= __atomic_load_n(&alphabet->label_num, __ATOMIC_ACQUIRE),
+        NULL, "%d/%d", index, alphabet->label_num);
 
-    return alphabet->labels[index].label;
+    return st_alphabet_label_at(alphabet, alphabet->label_offs[index]);
 }
 
 int st_alphabet_get_index(st_alphabet_t *alphabet, const char *label)
@@ -200,9 +749,14 @@ int st_alphabet_get_index(st_alphabet_t *alphabet, const char *label)
 
     ST_CHECK_PARAM(alphabet == NULL || label == NULL, -1);
 
+    if (alphabet->mph != NULL) {
+        return st_alphabet_mph_find(alphabet, label, strlen(label));
+    }
+
     arg.alphabet = alphabet;
     arg.label = label;
-    get_sign((char *)label, strlen(label), &snode.sign1, &snode.sign2);
+    arg.len = strlen(label);
+    get_sign((char *)label, arg.len, &snode.sign1, &snode.sign2);
     if (st_dict_seek(alphabet->index_dict, &snode, &arg) < 0) {
         return -1;
     }
@@ -210,71 +764,442 @@ int st_alphabet_get_index(st_alphabet_t *alphabet, const char *label)
     return (int)snode.uint1;
 }
 
-int st_alphabet_save_bin(st_alphabet_t *alphabet, FILE *fp)
+// look up n tokens, whose label and len are set in args
+static void st_alphabet_lookup_batch(st_alphabet_t *alphabet,
+        index_dict_eq_args_t *args, int n, int *indices)
 {
-    int ret = 0;
-
-    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
+    st_dict_node_t nodes[ST_ALPHABET_BATCH];
+    void *arg_ptrs[ST_ALPHABET_BATCH];
+    int rets[ST_ALPHABET_BATCH];
+    uint64_t hashes[ST_ALPHABET_BATCH];
+    st_alphabet_mph_t *mph;
+    size_t len;
+    int i;
 
-    ret = fwrite(&alphabet->label_num, sizeof(int), 1, fp);
-    if (ret != 1) {
-        ST_ERROR("Failed to write label_num");
-        return -1;
+    if (alphabet->mph != NULL) {
+        mph = alphabet->mph;
+        for (i = 0; i < n; i++) {
+            len = min(args[i].len, (size_t)(MAX_SYM_LEN - 1));
+            hashes[i] = st_alphabet_label_hash(args[i].label, len, mph->seed);
+            __builtin_prefetch(mph->pilots
+                    + st_alphabet_range(hashes[i], mph->bucket_num));
+        }
+        for (i = 0; i < n; i++) {
+            indices[i] = (int)st_alphabet_mph_id(alphabet, hashes[i]);
+            __builtin_prefetch(alphabet->label_offs + indices[i]);
+        }
+        for (i = 0; i < n; i++) {
+            len = min(args[i].len, (size_t)(MAX_SYM_LEN - 1));
+            if (!st_alphabet_label_eq(alphabet, indices[i], args[i].label,
+                        len)) {
+                indices[i] = -1;
+            }
+        }
+        return;
     }
 
-    ret = fwrite(alphabet->labels, sizeof(st_label_t),
-        alphabet->label_num, fp);
-    if (ret != alphabet->label_num) {
-        ST_ERROR("Failed to write labels");
-        return -1;
+    for (i = 0; i < n; i++) {
+        get_sign(args[i].label, args[i].len, &nodes[i].sign1,
+                &nodes[i].sign2);
+        args[i].alphabet = alphabet;
+        arg_ptrs[i] = args + i;
     }
 
-#ifdef _ST_ALPHABET_SAVE_DICT_
-    if (st_dict_save(alphabet->index_dict, fp) < 0) {
-        ST_ERROR("Failed to save index_dict");
-        return -1;
+    (void)st_dict_seek_batch(alphabet->index_dict, nodes, n, arg_ptrs, rets);
+    for (i = 0; i < n; i++) {
+        indices[i] = (rets[i] == 0) ? (int)nodes[i].uint1 : -1;
     }
-#endif
-
-    return 0;
 }
 
-int st_alphabet_save_txt(st_alphabet_t *alphabet, FILE *fp)
+int st_alphabet_get_index_batch(st_alphabet_t *alphabet, const char *line,
+        const char *seps, int *indices, int max_num)
 {
-    st_label_t *labels;
-    int i;
+    index_dict_eq_args_t args[ST_ALPHABET_BATCH];
+    bool is_sep[256];
+    const char *p;
+    int n;
+    int m;
 
-    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
+    ST_CHECK_PARAM(alphabet == NULL || line == NULL || indices == NULL
+            || max_num < 0, -1);
 
-    labels = alphabet->labels;
-    for(i = 0; i < alphabet->label_num; i++) {
-        if (labels[i].symid != -1) {
-            if (fprintf(fp, "%s\t%d\n", labels[i].label,
-                        labels[i].symid) < 0) {
-                ST_ERROR("Failed to fprintf sym[%d]", i);
-                return -1;
+    if (seps == NULL) {
+        seps = " \t\r\n";
+    }
+    memset(is_sep, 0, sizeof(is_sep));
+    for (p = seps; *p != '\0'; p++) {
+        is_sep[(unsigned char)*p] = true;
+    }
+
+    n = 0;
+    p = line;
+    while (true) {
+        for (m = 0; m < ST_ALPHABET_BATCH; m++) {
+            while (*p != '\0' && is_sep[(unsigned char)*p]) {
+                p++;
+            }
+            if (*p == '\0') {
+                break;
             }
+            args[m].label = p;
+            while (*p != '\0' && !is_sep[(unsigned char)*p]) {
+                p++;
+            }
+            args[m].len = p - args[m].label;
+        }
+        if (m == 0) {
+            break;
+        }
+
+        if (n + m > max_num) {
+            ST_ERROR("Too many tokens[>%d].", max_num);
+            return -1;
         }
+        st_alphabet_lookup_batch(alphabet, args, m, indices + n);
+        n += m;
     }
 
-    return 0;
+    return n;
 }
 
-static int st_alphabet_generate_index_dict(st_alphabet_t *alphabet)
-{
-    st_dict_node_t snode;
-    st_dict_t *index_dict = NULL;
-    int i;
+/*
+ * Binary format.
+ *
+ * Files saved by old versions hold label_num and label_num st_label_t,
+ * followed by index_dict if built with _ST_ALPHABET_SAVE_DICT_.
+ *
+ * Current files start with a st_alphabet_header_t, followed by label_offs,
+ * the label arena and index_dict saved by st_dict_save. Frozen alphabets
+ * have a st_alphabet_mph_header_t, pilots, remap and ids instead of
+ * index_dict. Each part starts at a multiple of ST_DICT_ALIGN from the
+ * beginning of the file, so a mapped file can be used in place.
+ */
+#define ST_ALPHABET_MAGIC   0x504C4153 // "SALP"
+#define ST_ALPHABET_VERSION 1
 
-    if ((index_dict = st_dict_create((int)(alphabet->label_num * 1.5),
-        ST_DICT_REALLOC_NUM, NULL, NULL, false)) == NULL) {
+typedef struct _st_alphabet_header_t_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_shift;
+    int32_t  label_num;
+    uint64_t pool_size;
+    uint32_t flags;
+
+    char     reserved[36];
+} st_alphabet_header_t;
+
+#define ST_ALPHABET_FLAG_FROZEN 0x1
+
+typedef struct _st_alphabet_mph_header_t_ {
+    uint64_t seed;
+    uint32_t bucket_num;
+    uint32_t table_size;
+
+    char     reserved[48];
+} st_alphabet_mph_header_t;
+
+#define st_alphabet_align(sz) (((sz) + ST_DICT_ALIGN - 1) \
+        & ~((size_t)ST_DICT_ALIGN - 1))
+
+static int st_alphabet_write_pad(FILE *fp, size_t sz)
+{
+    static const char zeros[ST_DICT_ALIGN] = {0};
+    size_t pad;
+
+    pad = st_alphabet_align(sz) - sz;
+    if (pad > 0 && fwrite(zeros, 1, pad, fp) != pad) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int st_alphabet_read_pad(FILE *fp, size_t sz)
+{
+    char buf[ST_DICT_ALIGN];
+    size_t pad;
+
+    pad = st_alphabet_align(sz) - sz;
+    if (pad > 0 && fread(buf, 1, pad, fp) != pad) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int st_alphabet_write_array(FILE *fp, const void *arr, size_t sz,
+        size_t n)
+{
+    if (fwrite(arr, sz, n, fp) != n) {
+        return -1;
+    }
+
+    return st_alphabet_write_pad(fp, sz * n);
+}
+
+static int st_alphabet_read_array(FILE *fp, void *arr, size_t sz, size_t n)
+{
+    if (fread(arr, sz, n, fp) != n) {
+        return -1;
+    }
+
+    return st_alphabet_read_pad(fp, sz * n);
+}
+
+static int st_alphabet_save_mph(st_alphabet_t *alphabet, FILE *fp)
+{
+    st_alphabet_mph_header_t header;
+    st_alphabet_mph_t *mph;
+
+    mph = alphabet->mph;
+    memset(&header, 0, sizeof(header));
+    header.seed = mph->seed;
+    header.bucket_num = mph->bucket_num;
+    header.table_size = mph->table_size;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to write mph header");
+        return -1;
+    }
+
+    if (st_alphabet_write_array(fp, mph->pilots, sizeof(uint16_t),
+                mph->bucket_num) < 0
+            || st_alphabet_write_array(fp, mph->remap, sizeof(uint32_t),
+                mph->table_size - alphabet->label_num) < 0
+            || st_alphabet_write_array(fp, mph->ids, sizeof(uint32_t),
+                alphabet->label_num) < 0) {
+        ST_ERROR("Failed to write mph");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int st_alphabet_check_mph_header(st_alphabet_mph_header_t *header,
+        int label_num)
+{
+    if (header->bucket_num == 0 || header->table_size <= label_num) {
+        ST_ERROR("Invalid mph header.");
+        return -1;
+    }
+
+    return 0;
+}
+
+// remap and ids index the n labels, so lookups stay in bounds
+static int st_alphabet_check_mph(st_alphabet_mph_t *mph, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < mph->table_size - n; i++) {
+        if (mph->remap[i] >= n) {
+            ST_ERROR("Invalid mph remap[%u].", i);
+            return -1;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (mph->ids[i] >= n) {
+            ST_ERROR("Invalid mph ids[%u].", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int st_alphabet_load_mph(st_alphabet_t *alphabet, FILE *fp)
+{
+    st_alphabet_mph_header_t header;
+    st_alphabet_mph_t *mph;
+    uint32_t n;
+
+    n = (uint32_t)alphabet->label_num;
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to read mph header");
+        return -1;
+    }
+    if (st_alphabet_check_mph_header(&header, n) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_mph_header.");
+        return -1;
+    }
+
+    mph = st_alphabet_mph_alloc(header.seed, header.bucket_num,
+            header.table_size);
+    if (mph == NULL) {
+        ST_ERROR("Failed to st_alphabet_mph_alloc.");
+        return -1;
+    }
+    alphabet->mph = mph;
+
+    mph->pilots = (uint16_t *)st_malloc(sizeof(uint16_t) * mph->bucket_num);
+    mph->remap = (uint32_t *)st_malloc(sizeof(uint32_t)
+            * (mph->table_size - n));
+    mph->ids = (uint32_t *)st_malloc(sizeof(uint32_t) * n);
+    if (mph->pilots == NULL || mph->remap == NULL || mph->ids == NULL) {
+        ST_ERROR("Failed to st_malloc mph.");
+        return -1;
+    }
+
+    if (st_alphabet_read_array(fp, mph->pilots, sizeof(uint16_t),
+                mph->bucket_num) < 0
+            || st_alphabet_read_array(fp, mph->remap, sizeof(uint32_t),
+                mph->table_size - n) < 0
+            || st_alphabet_read_array(fp, mph->ids, sizeof(uint32_t), n) < 0) {
+        ST_ERROR("Failed to read mph");
+        return -1;
+    }
+
+    if (st_alphabet_check_mph(mph, n) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_mph.");
+        return -1;
+    }
+
+    return 0;
+}
+
+// use a saved mph in place
+static int st_alphabet_map_mph(st_alphabet_t *alphabet, const char *buf,
+        size_t len)
+{
+    st_alphabet_mph_header_t header;
+    st_alphabet_mph_t *mph;
+    size_t off;
+    size_t n;
+
+    n = (size_t)alphabet->label_num;
+    if (len < sizeof(header)) {
+        ST_ERROR("Buffer too small for mph header.");
+        return -1;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (st_alphabet_check_mph_header(&header, (int)n) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_mph_header.");
+        return -1;
+    }
+    off = sizeof(header);
+    if (off + st_alphabet_align(sizeof(uint16_t) * header.bucket_num)
+            + st_alphabet_align(sizeof(uint32_t) * (header.table_size - n))
+            + sizeof(uint32_t) * n > len) {
+        ST_ERROR("Buffer too small for mph.");
+        return -1;
+    }
+
+    mph = st_alphabet_mph_alloc(header.seed, header.bucket_num,
+            header.table_size);
+    if (mph == NULL) {
+        ST_ERROR("Failed to st_alphabet_mph_alloc.");
+        return -1;
+    }
+    mph->mapped = true;
+    alphabet->mph = mph;
+
+    mph->pilots = (uint16_t *)(buf + off);
+    off += st_alphabet_align(sizeof(uint16_t) * mph->bucket_num);
+    mph->remap = (uint32_t *)(buf + off);
+    off += st_alphabet_align(sizeof(uint32_t) * (mph->table_size - n));
+    mph->ids = (uint32_t *)(buf + off);
+
+    if (st_alphabet_check_mph(mph, (uint32_t)n) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_mph.");
+        return -1;
+    }
+
+    return 0;
+}
+
+int st_alphabet_save_bin(st_alphabet_t *alphabet, FILE *fp)
+{
+    st_alphabet_header_t header;
+    uint64_t sz;
+    int i;
+
+    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ST_ALPHABET_MAGIC;
+    header.version = ST_ALPHABET_VERSION;
+    header.chunk_shift = ST_ALPHABET_CHUNK_SHIFT;
+    header.label_num = alphabet->label_num;
+    header.pool_size = alphabet->pool_size;
+    header.flags = (alphabet->mph != NULL) ? ST_ALPHABET_FLAG_FROZEN : 0;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to write header");
+        return -1;
+    }
+
+    if (fwrite(alphabet->label_offs, sizeof(uint64_t), alphabet->label_num,
+                fp) != alphabet->label_num
+            || st_alphabet_write_pad(fp,
+                sizeof(uint64_t) * alphabet->label_num) < 0) {
+        ST_ERROR("Failed to write label_offs");
+        return -1;
+    }
+
+    for (i = 0; i < alphabet->chunk_num; i++) {
+        sz = min(alphabet->pool_size - ((uint64_t)i << ST_ALPHABET_CHUNK_SHIFT),
+                (uint64_t)ST_ALPHABET_CHUNK_SIZE);
+        if (fwrite(alphabet->label_chunks[i], 1, sz, fp) != sz) {
+            ST_ERROR("Failed to write labels");
+            return -1;
+        }
+    }
+    if (st_alphabet_write_pad(fp, alphabet->pool_size) < 0) {
+        ST_ERROR("Failed to write labels");
+        return -1;
+    }
+
+    if (alphabet->mph != NULL) {
+        if (st_alphabet_save_mph(alphabet, fp) < 0) {
+            ST_ERROR("Failed to st_alphabet_save_mph.");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (st_dict_save(alphabet->index_dict, fp) < 0) {
+        ST_ERROR("Failed to save index_dict");
+        return -1;
+    }
+
+    return 0;
+}
+
+int st_alphabet_save_txt(st_alphabet_t *alphabet, FILE *fp)
+{
+    int i;
+
+    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
+
+    for(i = 0; i < alphabet->label_num; i++) {
+        if (alphabet->label_offs[i] != ST_ALPHABET_NO_LABEL) {
+            if (fprintf(fp, "%s\t%d\n", st_alphabet_label_at(alphabet,
+                            alphabet->label_offs[i]), i) < 0) {
+                ST_ERROR("Failed to fprintf sym[%d]", i);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int st_alphabet_generate_index_dict(st_alphabet_t *alphabet)
+{
+    st_dict_node_t snode;
+    st_dict_t *index_dict = NULL;
+    char *label;
+    int i;
+
+    if ((index_dict = st_alphabet_create_index_dict(alphabet->label_num,
+                    NULL, false)) == NULL) {
         ST_ERROR("Failed to alloc index_dict");
         goto ERR;
     }
 
     for(i = 0; i < alphabet->label_num; i++) {
-        get_sign(alphabet->labels[i].label, strlen(alphabet->labels[i].label),
-                &snode.sign1, &snode.sign2);
+        label = st_alphabet_label_at(alphabet, alphabet->label_offs[i]);
+        get_sign(label, strlen(label), &snode.sign1, &snode.sign2);
         snode.uint1 = (uint)i;
         if (st_dict_add(index_dict, &snode, NULL) < 0) {
             ST_ERROR("Failed to st_dict_add.");
@@ -298,21 +1223,13 @@ int st_alphabet_load_txt(st_alphabet_t *alphabet, FILE *fp, int label_num)
     int id;
     int i;
 
-    st_label_t *labels;
-
     ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
 
-    labels = (st_label_t *)st_malloc(label_num * sizeof(st_label_t));
-    if (labels == NULL) {
-        ST_ERROR("Failed to allocate memory for labels.");
+    if (st_alphabet_alloc_offs(alphabet, label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
         return -1;
     }
 
-    for(i = 0; i < label_num; i++) {
-        labels[i].symid = -1;
-        labels[i].label[0] = 0;
-    }
-
     i = 0;
     while(fgets(line, MAX_LINE_LEN, fp)) {
         num_fields = split_line(line, sym_id, 2, MAX_LINE_LEN, " \t");
@@ -332,14 +1249,15 @@ int st_alphabet_load_txt(st_alphabet_t *alphabet, FILE *fp, int label_num)
             return -1;
         }
 
-        if (labels[id].symid != -1) {
+        if (alphabet->label_offs[id] != ST_ALPHABET_NO_LABEL) {
             ST_ERROR("Duplicated symbol [%d:%s].", id, sym_id);
             return -1;
         }
 
-        strncpy(labels[id].label, sym_id, MAX_SYM_LEN);
-        labels[id].label[MAX_SYM_LEN - 1] = 0;
-        labels[id].symid = id;
+        if (st_alphabet_put_label(alphabet, id, sym_id) < 0) {
+            ST_ERROR("Failed to st_alphabet_put_label.");
+            return -1;
+        }
 
         i++;
         if (i >= label_num) {
@@ -348,14 +1266,12 @@ int st_alphabet_load_txt(st_alphabet_t *alphabet, FILE *fp, int label_num)
     }
 
     for(i = 0; i < label_num; i++) {
-        if (labels[i].symid == -1) {
+        if (alphabet->label_offs[i] == ST_ALPHABET_NO_LABEL) {
             ST_ERROR("Empty symbol for id[%d]", i);
             return -1;
         }
     }
 
-    alphabet->labels = labels;
-    alphabet->max_label_num = label_num;
     alphabet->label_num = label_num;
 
     if (st_alphabet_generate_index_dict(alphabet) < 0) {
@@ -390,134 +1306,774 @@ ERR:
     return NULL;
 }
 
-st_alphabet_t* st_alphabet_load_from_txt_file(const char *file)
+/*
+ * Parallel text loader.
+ *
+ * The mapped file is cut into nthreads ranges on line boundaries. Every
+ * thread parses and signs the labels of its range, then the labels are
+ * put into the arena in id order and index_dict is built in bulk.
+ */
+typedef struct _st_alphabet_txt_entry_t_ {
+    size_t off; /* label in file. */
+    int len;
+    int id;
+    st_dict_sign_t sign1;
+    st_dict_sign_t sign2;
+} st_alphabet_txt_entry_t;
+
+typedef struct _st_alphabet_txt_args_t_ {
+    const char *buf;
+    size_t from;
+    size_t to;
+
+    st_alphabet_txt_entry_t *entries;
+    int num;
+    int cap;
+    int ret;
+} st_alphabet_txt_args_t;
+
+#define st_alphabet_is_sep(c) ((c) == ' ' || (c) == '\t')
+
+// parse "label id" in [p, e)
+static int st_alphabet_parse_line(const char *buf, const char *p,
+        const char *e, st_alphabet_txt_entry_t *entry)
 {
-    char line[MAX_LINE_LEN];
-    st_alphabet_t *alphabet = NULL;
-    FILE *fp = NULL;
-    int label_num;
-
-    ST_CHECK_PARAM(file == NULL, NULL);
-
-    fp = st_fopen(file, "r");
-    if (fp == NULL) {
-        ST_ERROR("Failed to open file[%s]", file);
-        goto ERR;
-    }
-
-    label_num = 0;
-    while(fgets(line, MAX_LINE_LEN, fp) != NULL) {
-        ++label_num;
-    }
-
-    if (label_num <= 0) {
-        goto ERR;
-    }
-
-    rewind(fp);
+    const char *q;
+    long id;
 
-    alphabet = st_alphabet_load_from_txt(fp, label_num);
-    if (alphabet == NULL) {
-        ST_ERROR("Failed to st_alphabet_load_from_txt.");
-        goto ERR;
+    while (p < e && st_alphabet_is_sep(*p)) {
+        p++;
     }
-
-    safe_st_fclose(fp);
-    return alphabet;
-ERR:
-    safe_st_fclose(fp);
-    safe_st_alphabet_destroy(alphabet);
-    return NULL;
-}
-
-static int st_alphabet_load_bin(st_alphabet_t *alphabet, FILE *fp)
-{
-    int ret = 0;
-
-    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
-
-    ret = fread(&alphabet->label_num, sizeof(int), 1, fp);
-    if (ret != 1) {
-        ST_ERROR("Failed to read label_num");
+    for (q = p; q < e && !st_alphabet_is_sep(*q); q++);
+    if (q == p || q - p >= MAX_LINE_LEN) {
         return -1;
     }
-    alphabet->max_label_num = alphabet->label_num;
-
-    alphabet->labels = (st_label_t *)
-        st_malloc(sizeof(st_label_t)*alphabet->label_num);
-    if (alphabet->labels == NULL) {
-        ST_ERROR("Failed to st_malloc labels. [%d]", alphabet->label_num);
-        return -1;
+    entry->off = p - buf;
+    entry->len = (int)min(q - p, MAX_SYM_LEN - 1);
+
+    for (p = q; p < e && st_alphabet_is_sep(*p); p++);
+    id = 0;
+    for (q = p; q < e && *q >= '0' && *q <= '9'; q++) {
+        id = id * 10 + (*q - '0');
+        if (id > INT_MAX) {
+            return -1;
+        }
     }
-
-    ret = fread(alphabet->labels, sizeof(st_label_t), alphabet->label_num, fp);
-    if (ret != alphabet->label_num) {
-        ST_ERROR("Failed to read labels");
+    if (q == p) {
         return -1;
     }
+    entry->id = (int)id;
 
-#ifdef _ST_ALPHABET_SAVE_DICT_
-    if ((alphabet->index_dict = st_dict_load_from_bin(fp)) == NULL) {
-        ST_ERROR("Failed to load index_dict");
-        return -1;
-    }
-#else
-    if (st_alphabet_generate_index_dict(alphabet) < 0) {
-        ST_ERROR("Failed to st_alphabet_generate_index_dict.");
+    // CRLF lines are accepted like the serial loader does
+    for (p = q; p < e && (st_alphabet_is_sep(*p) || *p == '\r'); p++);
+    if (p != e) {
         return -1;
     }
-#endif
+
+    get_sign(buf + entry->off, entry->len, &entry->sign1, &entry->sign2);
 
     return 0;
 }
 
-st_alphabet_t* st_alphabet_load_from_bin(FILE *fp)
+static void* st_alphabet_parse_thread(void *args)
 {
-    st_alphabet_t *alphabet;
-
-    ST_CHECK_PARAM(fp == NULL, NULL);
-
-    if ((alphabet = st_alphabet_alloc()) == NULL) {
-        ST_ERROR("Failed to st_alphabet_alloc.");
-        return NULL;
-    }
+    st_alphabet_txt_args_t *targs;
+    st_alphabet_txt_entry_t *entries;
+    const char *p;
+    const char *e;
+    const char *end;
+
+    targs = (st_alphabet_txt_args_t *)args;
+    p = targs->buf + targs->from;
+    end = targs->buf + targs->to;
+    while (p < end) {
+        e = (const char *)memchr(p, '\n', end - p);
+        if (e == NULL) {
+            e = end;
+        }
 
-    if (st_alphabet_load_bin(alphabet, fp) < 0) {
-        ST_ERROR("Failed to st_alphabet_load_bin.");
-        goto ERR;
+        if (targs->num >= targs->cap) {
+            targs->cap = max(targs->cap * 2, 1024);
+            entries = (st_alphabet_txt_entry_t *)st_realloc(targs->entries,
+                    sizeof(st_alphabet_txt_entry_t) * targs->cap);
+            if (entries == NULL) {
+                ST_ERROR("Failed to st_realloc entries.");
+                targs->ret = -1;
+                return NULL;
+            }
+            targs->entries = entries;
+        }
 
+        if (st_alphabet_parse_line(targs->buf, p, e,
+                    targs->entries + targs->num) < 0) {
+            ST_ERROR("Invalid line in alphabet [%.*s]",
+                    (int)min(e - p, MAX_LINE_LEN), p);
+            targs->ret = -1;
+            return NULL;
+        }
+        targs->num++;
+        p = e + 1;
     }
 
-    return alphabet;
-ERR:
-    safe_st_alphabet_destroy(alphabet);
     return NULL;
 }
 
-st_alphabet_t* st_alphabet_dup(st_alphabet_t *a)
+static int st_alphabet_load_txt_buf(st_alphabet_t *alphabet,
+        const char *buf, size_t len, int nthreads)
 {
-    st_alphabet_t *alphabet = NULL;
-
-    ST_CHECK_PARAM(a == NULL, NULL);
+    st_alphabet_txt_args_t *targs = NULL;
+    st_alphabet_txt_entry_t **by_id = NULL;
+    st_alphabet_txt_entry_t *entry;
+    st_dict_node_t *nodes = NULL;
+    st_dict_id_t added;
+    const char *p;
+    size_t from;
+    int label_num;
+    int t, i;
+    int ret = -1;
 
-    alphabet = st_alphabet_alloc();
-    if (alphabet == NULL) {
-        ST_ERROR("Failed to alphabet_alloc.");
+    targs = (st_alphabet_txt_args_t *)st_malloc(
+            sizeof(st_alphabet_txt_args_t) * nthreads);
+    if (targs == NULL) {
+        ST_ERROR("Failed to st_malloc thread args.");
         goto ERR;
     }
+    memset(targs, 0, sizeof(st_alphabet_txt_args_t) * nthreads);
+
+    from = 0;
+    for (t = 0; t < nthreads; t++) {
+        targs[t].buf = buf;
+        targs[t].from = from;
+        targs[t].to = len * (t + 1) / nthreads;
+        if (targs[t].to < from) {
+            targs[t].to = from;
+        }
+        if (targs[t].to < len) {
+            p = (const char *)memchr(buf + targs[t].to, '\n',
+                    len - targs[t].to);
+            targs[t].to = (p == NULL) ? len : (size_t)(p - buf) + 1;
+        }
+        from = targs[t].to;
+    }
+
+    st_run_threads(st_alphabet_parse_thread, targs, sizeof(*targs), nthreads);
+
+    label_num = 0;
+    for (t = 0; t < nthreads; t++) {
+        if (targs[t].ret < 0) {
+            ST_ERROR("Failed to parse alphabet.");
+            goto ERR;
+        }
+        label_num += targs[t].num;
+    }
+    if (label_num <= 0) {
+        ST_ERROR("Empty alphabet.");
+        goto ERR;
+    }
+
+    by_id = (st_alphabet_txt_entry_t **)st_malloc(
+            sizeof(st_alphabet_txt_entry_t *) * label_num);
+    nodes = (st_dict_node_t *)st_malloc(sizeof(st_dict_node_t) * label_num);
+    if (by_id == NULL || nodes == NULL) {
+        ST_ERROR("Failed to st_malloc by_id.");
+        goto ERR;
+    }
+    memset(by_id, 0, sizeof(st_alphabet_txt_entry_t *) * label_num);
+
+    for (t = 0; t < nthreads; t++) {
+        for (i = 0; i < targs[t].num; i++) {
+            entry = targs[t].entries + i;
+            if (entry->id >= label_num) {
+                ST_ERROR("Wrong id[%d]>=label_num[%d].", entry->id,
+                        label_num);
+                goto ERR;
+            }
+            if (by_id[entry->id] != NULL) {
+                ST_ERROR("Duplicated symbol [%d:%.*s].", entry->id,
+                        entry->len, buf + entry->off);
+                goto ERR;
+            }
+            by_id[entry->id] = entry;
+        }
+    }
+
+    if (st_alphabet_alloc_offs(alphabet, label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
+        goto ERR;
+    }
+
+    for (i = 0; i < label_num; i++) {
+        entry = by_id[i];
+        if (st_alphabet_put_label_len(alphabet, i, buf + entry->off,
+                    entry->len) < 0) {
+            ST_ERROR("Failed to st_alphabet_put_label_len.");
+            goto ERR;
+        }
+        nodes[i].sign1 = entry->sign1;
+        nodes[i].sign2 = entry->sign2;
+        nodes[i].uint1 = (unsigned int)i;
+    }
+    alphabet->label_num = label_num;
 
-    alphabet->max_label_num = a->max_label_num;
-    alphabet->label_num = a->label_num;
-
-    alphabet->labels = (st_label_t *)
-        st_malloc(a->max_label_num * sizeof(st_label_t));
-    if (alphabet->labels == NULL) {
-        ST_ERROR("Failed to allocate memory for labels.");
+    if ((alphabet->index_dict = st_alphabet_create_index_dict(label_num,
+                    NULL, false)) == NULL) {
+        ST_ERROR("Failed to alloc index_dict");
+        goto ERR;
+    }
+
+    // repeated nodes are skipped, a repeated label under another id is not
+    // allowed by st_alphabet_load_from_txt_file either
+    added = st_dict_build_bulk(alphabet->index_dict, nodes, label_num,
+            nthreads);
+    if (added == ST_DICT_BAD_NODE) {
+        ST_ERROR("Failed to st_dict_build_bulk.");
+        goto ERR;
+    }
+    if (added != label_num) {
+        ST_ERROR("Repeated labels in alphabet. [%d/%d]", (int)added,
+                label_num);
         goto ERR;
     }
+    alphabet->index_dict->node_eq_func = index_dict_node_eq;
+
+    ret = 0;
+
+ERR:
+    if (targs != NULL) {
+        for (t = 0; t < nthreads; t++) {
+            safe_st_free(targs[t].entries);
+        }
+    }
+    safe_st_free(targs);
+    safe_st_free(by_id);
+    safe_st_free(nodes);
+    return ret;
+}
+
+st_alphabet_t* st_alphabet_load_from_txt_parallel(const char *file,
+        int nthreads)
+{
+    st_alphabet_t *alphabet = NULL;
+    struct stat st;
+    void *addr = MAP_FAILED;
+    int fd = -1;
+
+    ST_CHECK_PARAM(file == NULL || nthreads <= 0, NULL);
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        ST_ERROR("Failed to open file[%s].", file);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ST_ERROR("Failed to stat file[%s].", file);
+        goto ERR;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ST_ERROR("Failed to mmap file[%s].", file);
+        goto ERR;
+    }
+    safe_close(fd);
+    (void)madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    if ((alphabet = st_alphabet_alloc()) == NULL) {
+        ST_ERROR("Failed to st_alphabet_alloc.");
+        goto ERR;
+    }
+
+    if (st_alphabet_load_txt_buf(alphabet, (const char *)addr, st.st_size,
+                nthreads) < 0) {
+        ST_ERROR("Failed to st_alphabet_load_txt_buf.");
+        goto ERR;
+    }
+
+    (void)munmap(addr, st.st_size);
+    return alphabet;
+
+ERR:
+    safe_close(fd);
+    if (addr != MAP_FAILED) {
+        (void)munmap(addr, st.st_size);
+    }
+    safe_st_alphabet_destroy(alphabet);
+    return NULL;
+}
+
+st_alphabet_t* st_alphabet_load_from_txt_file(const char *file)
+{
+    char line[MAX_LINE_LEN];
+    st_alphabet_t *alphabet = NULL;
+    FILE *fp = NULL;
+    int label_num;
+
+    ST_CHECK_PARAM(file == NULL, NULL);
+
+    fp = st_fopen(file, "r");
+    if (fp == NULL) {
+        ST_ERROR("Failed to open file[%s]", file);
+        goto ERR;
+    }
+
+    label_num = 0;
+    while(fgets(line, MAX_LINE_LEN, fp) != NULL) {
+        ++label_num;
+    }
+
+    if (label_num <= 0) {
+        goto ERR;
+    }
+
+    rewind(fp);
+
+    alphabet = st_alphabet_load_from_txt(fp, label_num);
+    if (alphabet == NULL) {
+        ST_ERROR("Failed to st_alphabet_load_from_txt.");
+        goto ERR;
+    }
+
+    safe_st_fclose(fp);
+    return alphabet;
+ERR:
+    safe_st_fclose(fp);
+    safe_st_alphabet_destroy(alphabet);
+    return NULL;
+}
+
+// format without header, label_num was already read
+static int st_alphabet_load_legacy(st_alphabet_t *alphabet, FILE *fp,
+        int label_num)
+{
+    st_label_t rec;
+    int i;
+
+    if (label_num <= 0) {
+        ST_ERROR("Invalid label_num[%d]", label_num);
+        return -1;
+    }
+
+    if (st_alphabet_alloc_offs(alphabet, label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
+        return -1;
+    }
+
+    for (i = 0; i < label_num; i++) {
+        if (fread(&rec, sizeof(st_label_t), 1, fp) != 1) {
+            ST_ERROR("Failed to read labels");
+            return -1;
+        }
+        rec.label[MAX_SYM_LEN - 1] = 0;
+        if (st_alphabet_put_label(alphabet, i, rec.label) < 0) {
+            ST_ERROR("Failed to st_alphabet_put_label.");
+            return -1;
+        }
+    }
+    alphabet->label_num = label_num;
+
+#ifdef _ST_ALPHABET_SAVE_DICT_
+    if ((alphabet->index_dict = st_dict_load_from_bin(fp)) == NULL) {
+        ST_ERROR("Failed to load index_dict");
+        return -1;
+    }
+    if (alphabet->index_dict->max_load_factor <= 0) {
+        alphabet->index_dict->max_load_factor = ST_ALPHABET_MAX_LOAD_FACTOR;
+    }
+#else
+    if (st_alphabet_generate_index_dict(alphabet) < 0) {
+        ST_ERROR("Failed to st_alphabet_generate_index_dict.");
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+static int st_alphabet_parse_header(st_alphabet_header_t *header)
+{
+    if (header->version != ST_ALPHABET_VERSION) {
+        ST_ERROR("Unknown alphabet version[%u].", header->version);
+        return -1;
+    }
 
-    memcpy(alphabet->labels, a->labels,
-            sizeof(st_label_t)*a->max_label_num);
+    if (header->chunk_shift != ST_ALPHABET_CHUNK_SHIFT) {
+        ST_ERROR("Alphabet saved with different chunk size[%u/%d].",
+                header->chunk_shift, ST_ALPHABET_CHUNK_SHIFT);
+        return -1;
+    }
+
+    if (header->label_num <= 0 || header->pool_size == 0
+            || header->pool_size > ((uint64_t)INT_MAX
+                << ST_ALPHABET_CHUNK_SHIFT)) {
+        ST_ERROR("Invalid alphabet header.");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int st_alphabet_check_labels(st_alphabet_t *alphabet,
+        const char *last)
+{
+    int i;
+
+    // every label ends before the end of arena
+    if (*last != 0) {
+        ST_ERROR("Label arena not terminated.");
+        return -1;
+    }
+
+    for (i = 0; i < alphabet->label_num; i++) {
+        if (alphabet->label_offs[i] >= alphabet->pool_size) {
+            ST_ERROR("Invalid offset for label[%d].", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int st_alphabet_load_bin(st_alphabet_t *alphabet, FILE *fp)
+{
+    st_alphabet_header_t header;
+    uint64_t sz;
+    int i;
+
+    ST_CHECK_PARAM(alphabet == NULL || fp == NULL, -1);
+
+    if (fread(&header.magic, sizeof(header.magic), 1, fp) != 1) {
+        ST_ERROR("Failed to read magic");
+        return -1;
+    }
+
+    if (header.magic != ST_ALPHABET_MAGIC) {
+        // files saved before the header was introduced
+        return st_alphabet_load_legacy(alphabet, fp, (int)header.magic);
+    }
+
+    if (fread((char *)&header + sizeof(header.magic),
+                sizeof(header) - sizeof(header.magic), 1, fp) != 1) {
+        ST_ERROR("Failed to read header");
+        return -1;
+    }
+
+    if (st_alphabet_parse_header(&header) < 0) {
+        ST_ERROR("Failed to st_alphabet_parse_header.");
+        return -1;
+    }
+
+    if (st_alphabet_alloc_offs(alphabet, header.label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
+        return -1;
+    }
+
+    if (fread(alphabet->label_offs, sizeof(uint64_t), header.label_num, fp)
+                != header.label_num
+            || st_alphabet_read_pad(fp,
+                sizeof(uint64_t) * header.label_num) < 0) {
+        ST_ERROR("Failed to read label_offs");
+        return -1;
+    }
+
+    alphabet->max_chunk_num = (int)((header.pool_size
+                + ST_ALPHABET_CHUNK_SIZE - 1) >> ST_ALPHABET_CHUNK_SHIFT);
+    alphabet->label_chunks = (char **)st_malloc(sizeof(char *)
+            * alphabet->max_chunk_num);
+    if (alphabet->label_chunks == NULL) {
+        ST_ERROR("Failed to st_malloc label_chunks.");
+        return -1;
+    }
+
+    for (i = 0; i < alphabet->max_chunk_num; i++) {
+        alphabet->label_chunks[i] = (char *)st_malloc(ST_ALPHABET_CHUNK_SIZE);
+        if (alphabet->label_chunks[i] == NULL) {
+            ST_ERROR("Failed to st_malloc label chunk.");
+            return -1;
+        }
+        alphabet->chunk_num++;
+        bzero(alphabet->label_chunks[i], ST_ALPHABET_CHUNK_SIZE);
+
+        sz = min(header.pool_size - ((uint64_t)i << ST_ALPHABET_CHUNK_SHIFT),
+                (uint64_t)ST_ALPHABET_CHUNK_SIZE);
+        if (fread(alphabet->label_chunks[i], 1, sz, fp) != sz) {
+            ST_ERROR("Failed to read labels");
+            return -1;
+        }
+    }
+    alphabet->pool_size = header.pool_size;
+    alphabet->label_num = header.label_num;
+
+    if (st_alphabet_read_pad(fp, header.pool_size) < 0) {
+        ST_ERROR("Failed to read labels");
+        return -1;
+    }
+
+    if (st_alphabet_check_labels(alphabet, st_alphabet_label_at(alphabet,
+                    alphabet->pool_size - 1)) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_labels.");
+        return -1;
+    }
+
+    if (header.flags & ST_ALPHABET_FLAG_FROZEN) {
+        if (st_alphabet_load_mph(alphabet, fp) < 0) {
+            ST_ERROR("Failed to st_alphabet_load_mph.");
+            return -1;
+        }
+        return 0;
+    }
+
+    if ((alphabet->index_dict = st_dict_load_from_bin(fp)) == NULL) {
+        ST_ERROR("Failed to load index_dict");
+        return -1;
+    }
+    alphabet->index_dict->node_eq_func = index_dict_node_eq;
+    // files written before the alphabet could grow have a fixed dict
+    if (alphabet->index_dict->max_load_factor <= 0) {
+        alphabet->index_dict->max_load_factor = ST_ALPHABET_MAX_LOAD_FACTOR;
+    }
+
+    return 0;
+}
+
+// use a saved alphabet in place, buf must be aligned to ST_DICT_ALIGN
+static int st_alphabet_map(st_alphabet_t *alphabet, const char *buf,
+        size_t len)
+{
+    st_alphabet_header_t header;
+    size_t off;
+    size_t sz;
+    int i;
+
+    if (len < sizeof(header)) {
+        ST_ERROR("Buffer too small for header.");
+        return -1;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic != ST_ALPHABET_MAGIC) {
+        ST_ERROR("Not an alphabet file, save it again to map it.");
+        return -1;
+    }
+    if (st_alphabet_parse_header(&header) < 0) {
+        ST_ERROR("Failed to st_alphabet_parse_header.");
+        return -1;
+    }
+
+    off = sizeof(header);
+    sz = sizeof(uint64_t) * header.label_num;
+    if (off + sz > len) {
+        ST_ERROR("Buffer too small for label_offs.");
+        return -1;
+    }
+    alphabet->label_offs = (uint64_t *)(buf + off);
+    off += st_alphabet_align(sz);
+
+    sz = header.pool_size;
+    if (off + sz > len) {
+        ST_ERROR("Buffer too small for labels.");
+        return -1;
+    }
+
+    // the arena is contiguous in file, cut it into chunks of the same size
+    alphabet->max_chunk_num = (int)((sz + ST_ALPHABET_CHUNK_SIZE - 1)
+            >> ST_ALPHABET_CHUNK_SHIFT);
+    alphabet->label_chunks = (char **)st_malloc(sizeof(char *)
+            * alphabet->max_chunk_num);
+    if (alphabet->label_chunks == NULL) {
+        ST_ERROR("Failed to st_malloc label_chunks.");
+        return -1;
+    }
+    for (i = 0; i < alphabet->max_chunk_num; i++) {
+        alphabet->label_chunks[i] = (char *)buf + off
+            + ((size_t)i << ST_ALPHABET_CHUNK_SHIFT);
+    }
+    alphabet->chunk_num = alphabet->max_chunk_num;
+    alphabet->pool_size = header.pool_size;
+    alphabet->label_num = header.label_num;
+    alphabet->max_label_num = header.label_num;
+
+    // offsets are used in place, check them as the loader does
+    if (st_alphabet_check_labels(alphabet, buf + off + sz - 1) < 0) {
+        ST_ERROR("Failed to st_alphabet_check_labels.");
+        return -1;
+    }
+    off += st_alphabet_align(sz);
+
+    if (header.flags & ST_ALPHABET_FLAG_FROZEN) {
+        if (st_alphabet_map_mph(alphabet, buf + off, len - off) < 0) {
+            ST_ERROR("Failed to st_alphabet_map_mph.");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (off >= len) {
+        ST_ERROR("Buffer too small for index_dict.");
+        return -1;
+    }
+    alphabet->index_dict = st_dict_map_buf(buf + off, len - off);
+    if (alphabet->index_dict == NULL) {
+        ST_ERROR("Failed to st_dict_map_buf.");
+        return -1;
+    }
+    alphabet->index_dict->node_eq_func = index_dict_node_eq;
+
+    return 0;
+}
+
+st_alphabet_t* st_alphabet_mmap(const char *file)
+{
+    st_alphabet_t *alphabet = NULL;
+    struct stat st;
+    void *addr;
+    int fd = -1;
+
+    ST_CHECK_PARAM(file == NULL, NULL);
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        ST_ERROR("Failed to open file[%s].", file);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ST_ERROR("Failed to stat file[%s].", file);
+        goto ERR;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ST_ERROR("Failed to mmap file[%s].", file);
+        goto ERR;
+    }
+    safe_close(fd);
+
+    if ((alphabet = st_alphabet_alloc()) == NULL) {
+        ST_ERROR("Failed to st_alphabet_alloc.");
+        (void)munmap(addr, st.st_size);
+        goto ERR;
+    }
+    alphabet->map_addr = addr;
+    alphabet->map_len = st.st_size;
+
+    if (st_alphabet_map(alphabet, (const char *)addr, st.st_size) < 0) {
+        ST_ERROR("Failed to st_alphabet_map.");
+        goto ERR;
+    }
+
+    return alphabet;
+
+ERR:
+    safe_close(fd);
+    safe_st_alphabet_destroy(alphabet);
+    return NULL;
+}
+
+st_alphabet_t* st_alphabet_load_from_bin(FILE *fp)
+{
+    st_alphabet_t *alphabet;
+
+    ST_CHECK_PARAM(fp == NULL, NULL);
+
+    if ((alphabet = st_alphabet_alloc()) == NULL) {
+        ST_ERROR("Failed to st_alphabet_alloc.");
+        return NULL;
+    }
+
+    if (st_alphabet_load_bin(alphabet, fp) < 0) {
+        ST_ERROR("Failed to st_alphabet_load_bin.");
+        goto ERR;
+
+    }
+
+    return alphabet;
+ERR:
+    safe_st_alphabet_destroy(alphabet);
+    return NULL;
+}
+
+st_alphabet_t* st_alphabet_dup(st_alphabet_t *a)
+{
+    st_alphabet_t *alphabet = NULL;
+    int i;
+
+    ST_CHECK_PARAM(a == NULL, NULL);
+
+    alphabet = st_alphabet_alloc();
+    if (alphabet == NULL) {
+        ST_ERROR("Failed to alphabet_alloc.");
+        goto ERR;
+    }
+
+    if (st_alphabet_alloc_offs(alphabet, a->max_label_num) < 0) {
+        ST_ERROR("Failed to st_alphabet_alloc_offs.");
+        goto ERR;
+    }
+    memcpy(alphabet->label_offs, a->label_offs,
+            sizeof(uint64_t) * a->max_label_num);
+    alphabet->label_num = a->label_num;
+
+    if (a->concurrent) {
+        if (st_alphabet_set_concurrent(alphabet) < 0) {
+            ST_ERROR("Failed to st_alphabet_set_concurrent.");
+            goto ERR;
+        }
+    }
+
+    if (a->chunk_num > 0) {
+        if (alphabet->max_chunk_num < a->chunk_num) {
+            alphabet->label_chunks = (char **)st_malloc(sizeof(char *)
+                    * a->chunk_num);
+            if (alphabet->label_chunks == NULL) {
+                ST_ERROR("Failed to st_malloc label_chunks.");
+                goto ERR;
+            }
+            alphabet->max_chunk_num = a->chunk_num;
+        }
+        for (i = 0; i < a->chunk_num; i++) {
+            alphabet->label_chunks[i] = (char *)st_malloc(
+                    ST_ALPHABET_CHUNK_SIZE);
+            if (alphabet->label_chunks[i] == NULL) {
+                ST_ERROR("Failed to st_malloc label chunk.");
+                goto ERR;
+            }
+            alphabet->chunk_num++;
+            bzero(alphabet->label_chunks[i], ST_ALPHABET_CHUNK_SIZE);
+            memcpy(alphabet->label_chunks[i], a->label_chunks[i],
+                    min(a->pool_size
+                        - ((uint64_t)i << ST_ALPHABET_CHUNK_SHIFT),
+                        (uint64_t)ST_ALPHABET_CHUNK_SIZE));
+        }
+        alphabet->pool_size = a->pool_size;
+    }
+
+    if (a->mph != NULL) {
+        alphabet->mph = st_alphabet_mph_alloc(a->mph->seed,
+                a->mph->bucket_num, a->mph->table_size);
+        if (alphabet->mph == NULL) {
+            ST_ERROR("Failed to st_alphabet_mph_alloc.");
+            goto ERR;
+        }
+        alphabet->mph->pilots = (uint16_t *)st_malloc(sizeof(uint16_t)
+                * a->mph->bucket_num);
+        alphabet->mph->remap = (uint32_t *)st_malloc(sizeof(uint32_t)
+                * (a->mph->table_size - a->label_num));
+        alphabet->mph->ids = (uint32_t *)st_malloc(sizeof(uint32_t)
+                * a->label_num);
+        if (alphabet->mph->pilots == NULL || alphabet->mph->remap == NULL
+                || alphabet->mph->ids == NULL) {
+            ST_ERROR("Failed to st_malloc mph.");
+            goto ERR;
+        }
+        memcpy(alphabet->mph->pilots, a->mph->pilots,
+                sizeof(uint16_t) * a->mph->bucket_num);
+        memcpy(alphabet->mph->remap, a->mph->remap,
+                sizeof(uint32_t) * (a->mph->table_size - a->label_num));
+        memcpy(alphabet->mph->ids, a->mph->ids,
+                sizeof(uint32_t) * a->label_num);
+
+        return alphabet;
+    }
 
     alphabet->index_dict = st_dict_dup(a->index_dict);
     if (alphabet->index_dict == NULL) {
@@ -531,3 +2087,267 @@ ERR:
     safe_st_alphabet_destroy(alphabet);
     return NULL;
 }
+
+typedef struct _st_alphabet_merge_entry_t_ {
+    const char *label;
+    size_t len;
+    unsigned int sign1;
+    unsigned int sign2;
+} st_alphabet_merge_entry_t;
+
+typedef struct _st_alphabet_merge_args_t_ {
+    st_alphabet_t **alphabets;
+    int *starts; /* first entry of every alphabet, num + 1. */
+    st_alphabet_merge_entry_t *entries;
+    int from;
+    int to;
+} st_alphabet_merge_args_t;
+
+// hash the labels of entries [from, to)
+static void* st_alphabet_merge_thread(void *args)
+{
+    st_alphabet_merge_args_t *margs;
+    st_alphabet_merge_entry_t *entry;
+    st_alphabet_t *a;
+    int k, g;
+
+    margs = (st_alphabet_merge_args_t *)args;
+    if (margs->from >= margs->to) {
+        return NULL;
+    }
+    for (k = 0; margs->starts[k + 1] <= margs->from; k++);
+    for (g = margs->from; g < margs->to; g++) {
+        while (g >= margs->starts[k + 1]) {
+            k++;
+        }
+        a = margs->alphabets[k];
+        entry = margs->entries + g;
+        entry->label = st_alphabet_label_at(a,
+                a->label_offs[g - margs->starts[k]]);
+        entry->len = strlen(entry->label);
+        get_sign((char *)entry->label, entry->len,
+                &entry->sign1, &entry->sign2);
+    }
+
+    return NULL;
+}
+
+st_alphabet_t* st_alphabet_merge(st_alphabet_t **alphabets, int num,
+        int **remaps, int nthreads)
+{
+    st_alphabet_merge_args_t *margs = NULL;
+    st_alphabet_merge_entry_t *entries = NULL;
+    st_alphabet_merge_entry_t *entry;
+    st_alphabet_t *alphabet = NULL;
+    index_dict_eq_args_t arg;
+    st_dict_node_t snode;
+    int *starts = NULL;
+    int64_t total;
+    int k, t, g;
+
+    ST_CHECK_PARAM(alphabets == NULL || num <= 0 || nthreads <= 0, NULL);
+
+    starts = (int *)st_malloc(sizeof(int) * (num + 1));
+    if (starts == NULL) {
+        ST_ERROR("Failed to st_malloc starts.");
+        goto ERR;
+    }
+    total = 0;
+    for (k = 0; k < num; k++) {
+        if (alphabets[k] == NULL) {
+            ST_ERROR("alphabets[%d] is NULL.", k);
+            goto ERR;
+        }
+        starts[k] = (int)total;
+        total += alphabets[k]->label_num;
+        if (total > INT_MAX) {
+            ST_ERROR("Too many labels to merge.");
+            goto ERR;
+        }
+    }
+    starts[num] = (int)total;
+
+    entries = (st_alphabet_merge_entry_t *)st_malloc(
+            sizeof(st_alphabet_merge_entry_t) * max(total, 1));
+    margs = (st_alphabet_merge_args_t *)st_malloc(
+            sizeof(st_alphabet_merge_args_t) * nthreads);
+    if (entries == NULL || margs == NULL) {
+        ST_ERROR("Failed to st_malloc merge args.");
+        goto ERR;
+    }
+
+    for (t = 0; t < nthreads; t++) {
+        margs[t].alphabets = alphabets;
+        margs[t].starts = starts;
+        margs[t].entries = entries;
+        margs[t].from = (int)(total * t / nthreads);
+        margs[t].to = (int)(total * (t + 1) / nthreads);
+    }
+    st_run_threads(st_alphabet_merge_thread, margs, sizeof(*margs), nthreads);
+
+    alphabet = st_alphabet_create((int)total);
+    if (alphabet == NULL) {
+        ST_ERROR("Failed to st_alphabet_create.");
+        goto ERR;
+    }
+
+    // first occurrences take the next id, in shard order
+    arg.alphabet = alphabet;
+    k = 0;
+    for (g = 0; g < total; g++) {
+        while (g >= starts[k + 1]) {
+            k++;
+        }
+        entry = entries + g;
+        snode.sign1 = entry->sign1;
+        snode.sign2 = entry->sign2;
+        arg.label = entry->label;
+        arg.len = entry->len;
+        if (st_dict_seek(alphabet->index_dict, &snode, &arg) < 0) {
+            snode.uint1 = alphabet->label_num;
+            if (st_alphabet_put_label_len(alphabet, snode.uint1,
+                        entry->label, entry->len) < 0) {
+                ST_ERROR("Failed to st_alphabet_put_label_len.");
+                goto ERR;
+            }
+            alphabet->label_num++;
+            if (st_dict_add_no_seek(alphabet->index_dict, &snode) < 0) {
+                ST_ERROR("Failed to add label[%s] into dict", entry->label);
+                goto ERR;
+            }
+        }
+        if (remaps != NULL && remaps[k] != NULL) {
+            remaps[k][g - starts[k]] = (int)snode.uint1;
+        }
+    }
+
+    safe_st_free(starts);
+    safe_st_free(entries);
+    safe_st_free(margs);
+    return alphabet;
+
+ERR:
+    safe_st_free(starts);
+    safe_st_free(entries);
+    safe_st_free(margs);
+    safe_st_alphabet_destroy(alphabet);
+    return NULL;
+}
+
+typedef struct _st_alphabet_freq_t_ {
+    uint64_t freq;
+    int id;
+} st_alphabet_freq_t;
+
+// descending frequency, then ascending id
+static int st_alphabet_freq_cmp(const void *a, const void *b)
+{
+    const st_alphabet_freq_t *fa = (const st_alphabet_freq_t *)a;
+    const st_alphabet_freq_t *fb = (const st_alphabet_freq_t *)b;
+
+    if (fa->freq != fb->freq) {
+        return (fa->freq > fb->freq) ? -1 : 1;
+    }
+
+    return (fa->id > fb->id) - (fa->id < fb->id);
+}
+
+int st_alphabet_relayout(st_alphabet_t *alphabet, const uint64_t *freqs,
+        int *new_ids)
+{
+    st_alphabet_freq_t *order = NULL;
+    st_alphabet_opt_t opt;
+    st_alphabet_t *tmp = NULL;
+    st_dict_node_t snode;
+    char **chunks;
+    uint64_t *offs;
+    st_dict_t *dict;
+    uint64_t pool_size;
+    char *label;
+    size_t len;
+    int chunk_num, max_chunk_num;
+    int i;
+
+    ST_CHECK_PARAM(alphabet == NULL || freqs == NULL, -1);
+
+    if (alphabet->map_addr != NULL || alphabet->mph != NULL) {
+        ST_ERROR("Can not relayout a mapped or frozen alphabet.");
+        return -1;
+    }
+
+    order = (st_alphabet_freq_t *)st_malloc(sizeof(st_alphabet_freq_t)
+            * max(alphabet->label_num, 1));
+    if (order == NULL) {
+        ST_ERROR("Failed to st_malloc order.");
+        goto ERR;
+    }
+    for (i = 0; i < alphabet->label_num; i++) {
+        order[i].freq = freqs[i];
+        order[i].id = i;
+    }
+    qsort(order, alphabet->label_num, sizeof(st_alphabet_freq_t),
+            st_alphabet_freq_cmp);
+
+    opt.concurrent = alphabet->concurrent;
+    tmp = st_alphabet_create_ex(alphabet->max_label_num, &opt);
+    if (tmp == NULL) {
+        ST_ERROR("Failed to st_alphabet_create_ex.");
+        goto ERR;
+    }
+
+    // hot labels share the first chunks and the front of node_pool
+    for (i = 0; i < alphabet->label_num; i++) {
+        label = st_alphabet_label_at(alphabet,
+                alphabet->label_offs[order[i].id]);
+        len = strlen(label);
+        if (st_alphabet_put_label_len(tmp, i, label, len) < 0) {
+            ST_ERROR("Failed to st_alphabet_put_label_len.");
+            goto ERR;
+        }
+        tmp->label_num++;
+
+        get_sign(label, len, &snode.sign1, &snode.sign2);
+        snode.uint1 = i;
+        if (st_dict_add_no_seek(tmp->index_dict, &snode) < 0) {
+            ST_ERROR("Failed to add label[%s] into dict", label);
+            goto ERR;
+        }
+    }
+
+    // swap the storage, tmp then frees the old one
+    chunks = alphabet->label_chunks;
+    chunk_num = alphabet->chunk_num;
+    max_chunk_num = alphabet->max_chunk_num;
+    pool_size = alphabet->pool_size;
+    offs = alphabet->label_offs;
+    dict = alphabet->index_dict;
+
+    alphabet->label_chunks = tmp->label_chunks;
+    alphabet->chunk_num = tmp->chunk_num;
+    alphabet->max_chunk_num = tmp->max_chunk_num;
+    alphabet->pool_size = tmp->pool_size;
+    alphabet->label_offs = tmp->label_offs;
+    alphabet->index_dict = tmp->index_dict;
+
+    tmp->label_chunks = chunks;
+    tmp->chunk_num = chunk_num;
+    tmp->max_chunk_num = max_chunk_num;
+    tmp->pool_size = pool_size;
+    tmp->label_offs = offs;
+    tmp->index_dict = dict;
+
+    if (new_ids != NULL) {
+        for (i = 0; i < alphabet->label_num; i++) {
+            new_ids[order[i].id] = i;
+        }
+    }
+
+    safe_st_free(order);
+    safe_st_alphabet_destroy(tmp);
+    return 0;
+
+ERR:
+    safe_st_free(order);
+    safe_st_alphabet_destroy(tmp);
+    return -1;
+}
@@ -29,31 +29,103 @@
 extern "C" {
 #endif
 
+#include <pthread.h>
+
 #include <stutils/st_macro.h>
 #include "st_dict.h"
 #include "st_mem.h"
 
 #define MAX_SYM_LEN         256
 
+/* record of a label in the bin file. */
 typedef struct _st_label_t
 {
     char label[MAX_SYM_LEN];
     int symid;
 } st_label_t;
 
+/*
+ * Labels are packed back to back, NUL terminated, in an arena made of
+ * chunks of ST_ALPHABET_CHUNK_SIZE bytes, and found by their offset in the
+ * arena. Chunks never move, so pointers returned by st_alphabet_get_label
+ * stay valid when more labels are added.
+ */
+#define ST_ALPHABET_CHUNK_SHIFT 16
+#define ST_ALPHABET_CHUNK_SIZE  (1 << ST_ALPHABET_CHUNK_SHIFT)
+#define ST_ALPHABET_NO_LABEL    UINT64_MAX
+
+/*
+ * Minimal perfect hash over the labels of a frozen alphabet, PTHash style.
+ * A label falls in one of bucket_num buckets, whose pilot sends it to a
+ * slot of table_size no other label uses. Slots at or beyond label_num are
+ * remapped to the free ones below, and ids gives the label in each slot.
+ */
+typedef struct _st_alphabet_mph_t
+{
+    uint64_t seed;
+    uint32_t bucket_num;
+    uint32_t table_size;
+    uint16_t *pilots; /* bucket_num. */
+    uint32_t *remap; /* table_size - label_num. */
+    uint32_t *ids; /* label_num. */
+    bool mapped; /* arrays point into a mapped file. */
+} st_alphabet_mph_t;
+
 typedef struct _st_alphabet_t
 {
-    st_label_t *labels;
+    char **label_chunks;
+    int chunk_num;
+    int max_chunk_num;
+    uint64_t pool_size; /* bytes used in the arena. */
+
+    uint64_t *label_offs; /* offset of every label in the arena. */
     int max_label_num;
     int label_num;
 
-    st_dict_t *index_dict;
+    st_dict_t *index_dict; /* NULL once frozen. */
+    st_alphabet_mph_t *mph; /* index of a frozen alphabet. */
+
+    void *map_addr; /* labels and index_dict point into a mapped file. */
+    size_t map_len;
+
+    bool concurrent;
+    pthread_mutex_t add_lock; /* serializes insertion of new labels. */
 } st_alphabet_t;
 
+/*
+ * Options for st_alphabet_create_ex. NULL means default values.
+ *
+ * With concurrent, st_alphabet_add_label may be called from any number of
+ * threads. Labels already in the alphabet are found without locking, as
+ * with st_alphabet_get_index, st_alphabet_get_index_batch and
+ * st_alphabet_get_label; only new labels take add_lock while they are
+ * inserted into index_dict, which has a single writer. The label arena
+ * and offsets never move, so readers are not blocked by insertions.
+ * Freezing, saving or duplicating must not race with insertions.
+ */
+typedef struct _st_alphabet_opt_t_
+{
+    bool concurrent;
+} st_alphabet_opt_t;
+
 st_alphabet_t* st_alphabet_load_from_txt(FILE *fp, int label_num);
 st_alphabet_t* st_alphabet_load_from_bin(FILE *fp);
 st_alphabet_t* st_alphabet_load_from_txt_file(const char *file);
 
+/*
+ * Same as st_alphabet_load_from_txt_file, with the file mapped and its
+ * lines parsed and signed by nthreads threads.
+ */
+st_alphabet_t* st_alphabet_load_from_txt_parallel(const char *file,
+        int nthreads);
+
+/*
+ * Map a file written by st_alphabet_save_bin read-only, and use the labels
+ * and index_dict in place, so processes mapping the same file share its
+ * pages. No label can be added to the returned alphabet.
+ */
+st_alphabet_t* st_alphabet_mmap(const char *file);
+
 int st_alphabet_save_bin(st_alphabet_t *alphabet, FILE *fp);
 int st_alphabet_save_txt(st_alphabet_t *alphabet, FILE *fp);
 
@@ -62,6 +134,16 @@ int st_alphabet_get_label_num(st_alphabet_t *alphabet);
 char *st_alphabet_get_label(st_alphabet_t *alphabet, int index);
 int st_alphabet_get_index(st_alphabet_t *alphabet, const char *label);
 
+/*
+ * Look up every token of line, split by any char of seps (blanks and line
+ * breaks if NULL), and write its index, or -1 if unknown, into indices.
+ * Tokens are signed in place and looked up in batches with their buckets
+ * prefetched. Returns the number of tokens, -1 on error or if there are
+ * more than max_num tokens.
+ */
+int st_alphabet_get_index_batch(st_alphabet_t *alphabet, const char *line,
+        const char *seps, int *indices, int max_num);
+
 #define safe_st_alphabet_destroy(ptr) do {\
     if((ptr) != NULL) {\
         st_alphabet_destroy(ptr);\
@@ -72,11 +154,50 @@ int st_alphabet_get_index(st_alphabet_t *alphabet, const char *label);
 
 void st_alphabet_destroy(st_alphabet_t *alphabet);
 
+/*
+ * max_label_num is the initial capacity, 0 for a small default. The
+ * alphabet grows when it is full, except in concurrent mode where
+ * max_label_num is a hard limit.
+ */
 st_alphabet_t* st_alphabet_create(int max_label_num);
+st_alphabet_t* st_alphabet_create_ex(int max_label_num,
+        const st_alphabet_opt_t *opt);
 int st_alphabet_add_label(st_alphabet_t *alphabet, const char *label_);
 
 st_alphabet_t* st_alphabet_dup(st_alphabet_t *a);
 
+/*
+ * Merge num alphabets into a new one. A label takes the next id at its
+ * first occurrence, alphabet by alphabet in order. When remaps is not
+ * NULL, remaps[k][i] is set to the merged id of label i of alphabets[k],
+ * and remaps[k] must hold st_alphabet_get_label_num(alphabets[k]) ints.
+ * Labels are hashed by nthreads threads, then copied once into the
+ * merged arena.
+ */
+st_alphabet_t* st_alphabet_merge(st_alphabet_t **alphabets, int num,
+        int **remaps, int nthreads);
+
+/*
+ * Renumber labels by descending freqs[id], ties keeping their order, so
+ * that the most frequent labels get the smallest ids. Their text is packed
+ * at the front of the arena and their dict nodes are inserted first, so a
+ * hot set of labels occupies few cache lines. When new_ids is not NULL,
+ * new_ids[old_id] is set to the new id of every label. Pointers from
+ * st_alphabet_get_label are invalidated, and the call must not race with
+ * any other access. Relayout before freezing, as frozen and mapped
+ * alphabets can not be renumbered.
+ */
+int st_alphabet_relayout(st_alphabet_t *alphabet, const uint64_t *freqs,
+        int *new_ids);
+
+/*
+ * Replace index_dict with a minimal perfect hash, which answers
+ * st_alphabet_get_index with one hash and one string compare, in about 4
+ * bytes per label. No label can be added afterwards. Frozen alphabets are
+ * saved and mapped with their hash.
+ */
+int st_alphabet_freeze(st_alphabet_t *alphabet);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,16 +21,392 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
-
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "st_log.h"
 #include "st_block_cache.h"
 
+#define ST_BCACHE_MPOL_BIND 2
+
+/*
+ * Every thread keeps a magazine of free block ids. Fetch pops from it and
+ * return pushes to it; only an empty magazine is refilled from, and a full
+ * one spilled to, the free_blocks of the nodes under the lock,
+ * ST_BCACHE_MAG_BATCH ids at a time.
+ */
+#define ST_BCACHE_MAG_SIZE  64
+#define ST_BCACHE_MAG_BATCH (ST_BCACHE_MAG_SIZE / 2)
+
+typedef struct _st_bcache_mag_t_
+{
+    st_block_cache_t *bcache;
+    int node; /* NUMA node of the thread, 0 without opt.numa. */
+    bcache_id_t num; /* written by its thread only. */
+    bcache_id_t ids[ST_BCACHE_MAG_SIZE];
+    struct _st_bcache_mag_t_ *prev;
+    struct _st_bcache_mag_t_ *next;
+} st_bcache_mag_t;
+
+#define st_bcache_pool(bcache, p) \
+    (__atomic_load_n(&(bcache)->dir, __ATOMIC_ACQUIRE)->leaves[ \
+     (p) >> ST_BCACHE_DIR_SHIFT] + ((p) & (ST_BCACHE_DIR_SIZE - 1)))
+
+// should hold the lock outside this function
+static void st_bcache_push_free(st_block_cache_t *bcache, bcache_id_t id)
+{
+    st_bcache_pool_t *pool;
+    st_bcache_node_t *node;
+
+    pool = st_bcache_pool(bcache, id / bcache->count);
+    node = bcache->nodes + pool->node;
+    node->free_blocks[node->num_free_blocks++] = id;
+    pool->num_free++;
+}
+
+// should hold the lock outside this function
+static void st_bcache_spill(st_block_cache_t *bcache, st_bcache_mag_t *mag,
+        bcache_id_t n)
+{
+    bcache_id_t num;
+
+    num = mag->num;
+    while (n > 0 && num > 0) {
+        st_bcache_push_free(bcache, mag->ids[--num]);
+        n--;
+    }
+    __atomic_store_n(&mag->num, num, __ATOMIC_RELAXED);
+}
+
+// NUMA node the calling thread runs on
+static int st_bcache_cur_node()
+{
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0
+            && node < ST_BCACHE_MAX_NODES) {
+        return (int)node;
+    }
+#endif
+
+    return 0;
+}
+
+// called when a thread exits, gives its free ids back
+static void st_bcache_mag_destroy(void *arg)
+{
+    st_bcache_mag_t *mag = (st_bcache_mag_t *)arg;
+    st_block_cache_t *bcache = mag->bcache;
+
+    (void)pthread_mutex_lock(&bcache->lock);
+    st_bcache_spill(bcache, mag, mag->num);
+    if (mag->prev != NULL) {
+        mag->prev->next = mag->next;
+    } else {
+        bcache->mags = mag->next;
+    }
+    if (mag->next != NULL) {
+        mag->next->prev = mag->prev;
+    }
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    safe_st_free(mag);
+}
+
+static st_bcache_mag_t* st_bcache_get_mag(st_block_cache_t *bcache)
+{
+    st_bcache_mag_t *mag;
+
+    mag = (st_bcache_mag_t *)pthread_getspecific(bcache->mag_key);
+    if (mag != NULL) {
+        return mag;
+    }
+
+    mag = (st_bcache_mag_t *)st_malloc(sizeof(st_bcache_mag_t));
+    if (mag == NULL) {
+        ST_ERROR("Failed to st_malloc magazine.");
+        return NULL;
+    }
+    memset(mag, 0, sizeof(st_bcache_mag_t));
+    mag->bcache = bcache;
+    mag->node = bcache->opt.numa ? st_bcache_cur_node() : 0;
+
+    if (pthread_setspecific(bcache->mag_key, mag) != 0) {
+        ST_ERROR("Failed to pthread_setspecific.");
+        safe_st_free(mag);
+        return NULL;
+    }
+
+    (void)pthread_mutex_lock(&bcache->lock);
+    mag->next = bcache->mags;
+    if (bcache->mags != NULL) {
+        bcache->mags->prev = mag;
+    }
+    bcache->mags = mag;
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    return mag;
+}
+
+static void* st_bcache_alloc_data(st_block_cache_t *bcache, int node)
+{
+    void *data;
+#ifdef SYS_mbind
+    unsigned long mask;
+#endif
+
+    if (!bcache->mmap_pools) {
+        return st_malloc(bcache->block_size * bcache->count);
+    }
+
+    data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (bcache->opt.hugetlb) {
+        data = mmap(NULL, bcache->pool_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data == MAP_FAILED) {
+            ST_WARNING("Failed to mmap huge pages, fall back to normal pages.");
+        }
+    }
+#endif
+    if (data == MAP_FAILED) {
+        data = mmap(NULL, bcache->pool_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            ST_ERROR("Failed to mmap pool. [%zu]", bcache->pool_len);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (bcache->opt.huge_pages || bcache->opt.hugetlb) {
+            if (madvise(data, bcache->pool_len, MADV_HUGEPAGE) != 0) {
+                ST_WARNING("Failed to madvise MADV_HUGEPAGE.");
+            }
+        }
+#endif
+    }
+
+#ifdef SYS_mbind
+    // before the pages are touched, so they are allocated on node
+    if (bcache->opt.numa) {
+        mask = 1UL << node;
+        if (syscall(SYS_mbind, data, bcache->pool_len, ST_BCACHE_MPOL_BIND,
+                    &mask, ST_BCACHE_MAX_NODES + 1, 0) != 0) {
+            ST_WARNING("Failed to mbind pool to node[%d].", node);
+        }
+    }
+#endif
+
+    return data;
+}
+
+// data may be loaded without the lock by fetch and read, while trim and
+// st_bcache_pop_free swap it under the lock
+#define st_bcache_pool_data(pool) \
+    ((char *)__atomic_load_n(&(pool)->data, __ATOMIC_ACQUIRE))
+
+static void st_bcache_free_data(st_block_cache_t *bcache,
+        st_bcache_pool_t *pool)
+{
+    void *data;
+
+    data = pool->data;
+    if (data == NULL) {
+        return;
+    }
+    __atomic_store_n(&pool->data, NULL, __ATOMIC_RELEASE);
+
+    if (bcache->mmap_pools) {
+        (void)munmap(data, bcache->pool_len);
+    } else {
+        safe_st_free(data);
+    }
+}
+
+// pop num ids from the top of node, keeping their order, top last
+// should hold the lock outside this function
+static int st_bcache_pop_free(st_block_cache_t *bcache,
+        st_bcache_node_t *node, bcache_id_t *ids, bcache_id_t num)
+{
+    st_bcache_pool_t *pool;
+    bcache_id_t i;
+    void *data;
+
+    for (i = 0; i < num; i++) {
+        pool = st_bcache_pool(bcache,
+                node->free_blocks[node->num_free_blocks - num + i]
+                / bcache->count);
+        // a trimmed pool gets its buffer back before it is used again
+        if (pool->data == NULL) {
+            data = st_bcache_alloc_data(bcache, pool->node);
+            if (data == NULL) {
+                ST_ERROR("Failed to alloc data buffer.");
+                return -1;
+            }
+            __atomic_store_n(&pool->data, data, __ATOMIC_RELEASE);
+        }
+    }
+
+    node->num_free_blocks -= num;
+    memcpy(ids, node->free_blocks + node->num_free_blocks,
+            sizeof(bcache_id_t) * num);
+    for (i = 0; i < num; i++) {
+        pool = st_bcache_pool(bcache, ids[i] / bcache->count);
+        pool->num_free--;
+        pool->trimmed = false;
+    }
+
+    return 0;
+}
+
+// make room for leaf l, keeping the old array for readers
+// should hold the lock outside this function
+static int st_bcache_grow_dir(st_block_cache_t *bcache, size_t l)
+{
+    st_bcache_dir_t *dir;
+    size_t size;
+
+    if (bcache->dir != NULL && l < bcache->dir->size) {
+        return 0;
+    }
+
+    size = (bcache->dir == NULL) ? 1 : bcache->dir->size * 2;
+    dir = (st_bcache_dir_t *)st_malloc(sizeof(st_bcache_dir_t)
+            + sizeof(st_bcache_pool_t *) * size);
+    if (dir == NULL) {
+        ST_ERROR("Failed to st_malloc directory.");
+        return -1;
+    }
+    memset(dir->leaves, 0, sizeof(st_bcache_pool_t *) * size);
+    dir->size = size;
+    dir->prev = bcache->dir;
+    if (dir->prev != NULL) {
+        memcpy(dir->leaves, dir->prev->leaves,
+                sizeof(st_bcache_pool_t *) * dir->prev->size);
+    }
+
+    __atomic_store_n(&bcache->dir, dir, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+// should hold the lock outside this function
+static int st_bcache_add_pool(st_block_cache_t *bcache, int node)
+{
+    st_bcache_node_t *free_node;
+    st_bcache_pool_t **leaf;
+    st_bcache_pool_t *pool;
+    bcache_id_t *free_blocks;
+    bcache_id_t cur_capacity;
+    size_t p;
+    bcache_id_t i;
+
+    p = bcache->num_pools;
+    cur_capacity = st_block_cache_capacity(bcache);
+    if (p >= bcache->max_pools
+            || cur_capacity > INT32_MAX - bcache->count) {
+        ST_ERROR("Too many pools[%zu].", p);
+        return -1;
+    }
+
+    if (st_bcache_grow_dir(bcache, p >> ST_BCACHE_DIR_SHIFT) < 0) {
+        ST_ERROR("Failed to st_bcache_grow_dir.");
+        return -1;
+    }
+    leaf = bcache->dir->leaves + (p >> ST_BCACHE_DIR_SHIFT);
+    if (*leaf == NULL) {
+        *leaf = (st_bcache_pool_t *)st_malloc(
+                sizeof(st_bcache_pool_t) * ST_BCACHE_DIR_SIZE);
+        if (*leaf == NULL) {
+            ST_ERROR("Failed to st_malloc directory leaf.");
+            return -1;
+        }
+        memset(*leaf, 0, sizeof(st_bcache_pool_t) * ST_BCACHE_DIR_SIZE);
+    }
+    pool = st_bcache_pool(bcache, p);
+
+    // a node holds at most the ids of its own pools
+    free_node = bcache->nodes + node;
+    free_blocks = (bcache_id_t *)st_realloc(free_node->free_blocks,
+        sizeof(bcache_id_t) * (free_node->max_free_blocks + bcache->count));
+    if (free_blocks == NULL) {
+        ST_ERROR("Failed to st_realloc free_blocks.");
+        return -1;
+    }
+    free_node->free_blocks = free_blocks;
+    free_node->max_free_blocks += bcache->count;
+
+    pool->data = st_bcache_alloc_data(bcache, node);
+    if (pool->data == NULL) {
+        ST_ERROR("Failed to alloc data buffer.");
+        return -1;
+    }
+
+    pool->ref_counts = (bcache_id_t *)st_malloc(sizeof(bcache_id_t)
+            * bcache->count);
+    if (pool->ref_counts == NULL) {
+        ST_ERROR("Failed to st_malloc ref_counts.");
+        st_bcache_free_data(bcache, pool);
+        return -1;
+    }
+    memset(pool->ref_counts, 0, sizeof(bcache_id_t) * bcache->count);
+    pool->node = node;
+    pool->num_free = bcache->count;
+    pool->trimmed = false;
+
+    if (bcache->opt.keyed) {
+        pool->keys = (uint64_t *)st_malloc(sizeof(uint64_t) * bcache->count);
+        pool->clock_bits = (uint8_t *)st_malloc(sizeof(uint8_t)
+                * bcache->count);
+        if (pool->keys == NULL || pool->clock_bits == NULL) {
+            ST_ERROR("Failed to st_malloc keys.");
+            safe_st_free(pool->keys);
+            safe_st_free(pool->clock_bits);
+            safe_st_free(pool->ref_counts);
+            st_bcache_free_data(bcache, pool);
+            return -1;
+        }
+        memset(pool->keys, 0, sizeof(uint64_t) * bcache->count);
+        memset(pool->clock_bits, 0, sizeof(uint8_t) * bcache->count);
+    }
+
+    // lowest ids on top of the stack
+    for (i = bcache->count - 1; i >= 0; i--) {
+        free_node->free_blocks[free_node->num_free_blocks++] = i + cur_capacity;
+    }
+
+    // the pool must be ready before lock-free readers see it
+    __atomic_store_n(&bcache->num_pools, p + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+static st_dict_t* st_bcache_create_key_dict(st_block_cache_t *bcache)
+{
+    st_dict_opt_t dict_opt;
+
+    dict_opt.engine = ST_DICT_ENGINE_OPEN;
+    dict_opt.max_load_factor = 0;
+    dict_opt.concurrent = false;
+    dict_opt.value_size = 0;
+
+    return st_dict_create_ex(bcache->count, ST_DICT_REALLOC_NUM,
+            NULL, NULL, false, &dict_opt);
+}
+
 st_block_cache_t* st_block_cache_create(size_t block_size, bcache_id_t count)
+{
+    return st_block_cache_create_ex(block_size, count, NULL);
+}
+
+st_block_cache_t* st_block_cache_create_ex(size_t block_size,
+        bcache_id_t count, const st_block_cache_opt_t *opt)
 {
     st_block_cache_t *bcache = NULL;
-    bcache_id_t i;
+    size_t page_size;
 
     ST_CHECK_PARAM(block_size <= 0 || count <= 0, NULL);
 
@@ -43,39 +419,60 @@ st_block_cache_t* st_block_cache_create(size_t block_size, bcache_id_t count)
 
     bcache->block_size = block_size;
     bcache->count = count;
+    if (opt != NULL) {
+        bcache->opt = *opt;
+    }
 
-    bcache->data = (void **)st_malloc(sizeof(void *));
-    if (bcache->data == NULL) {
-        ST_ERROR("Failed to st_malloc data buffer pool.");
-        goto ERR;
+    // ids take the whole bcache_id_t range, as before the directory
+    bcache->max_pools = (size_t)INT32_MAX / count + 1;
+    if (bcache->opt.max_blocks > 0) {
+        bcache->max_pools = min((size_t)(bcache->opt.max_blocks + count - 1)
+                / count, bcache->max_pools);
     }
-    bcache->num_pools = 1;
 
-    bcache->data[0] = (void *)st_malloc(block_size * count);
-    if (bcache->data[0] == NULL) {
-        ST_ERROR("Failed to st_malloc data buffer.");
-        goto ERR;
+    bcache->mmap_pools = (bcache->opt.huge_pages || bcache->opt.hugetlb
+            || bcache->opt.numa);
+    if (bcache->mmap_pools) {
+        if (bcache->opt.huge_pages || bcache->opt.hugetlb) {
+            page_size = ST_BCACHE_HUGE_PAGE_SIZE;
+            if (block_size * count < ST_BCACHE_HUGE_PAGE_SIZE / 2) {
+                ST_WARNING("Pool of %zu bytes rounded up to a huge page, "
+                        "more than half of it is wasted.",
+                        block_size * count);
+            }
+        } else {
+            page_size = (size_t)sysconf(_SC_PAGESIZE);
+        }
+        bcache->pool_len = (block_size * count + page_size - 1)
+            / page_size * page_size;
     }
 
-    bcache->ref_counts = (bcache_id_t *)st_malloc(sizeof(bcache_id_t) * count);
-    if (bcache->ref_counts == NULL) {
-        ST_ERROR("Failed to st_malloc ref_counts.");
+    if (pthread_mutex_init(&bcache->lock, NULL) != 0) {
+        ST_ERROR("Failed to pthread_mutex_init lock.");
+        safe_st_free(bcache);
         goto ERR;
     }
-    memset(bcache->ref_counts, 0, sizeof(bcache_id_t) * count);
 
-    bcache->free_blocks = (bcache_id_t *)st_malloc(sizeof(bcache_id_t) * count);
-    if (bcache->free_blocks == NULL) {
-        ST_ERROR("Failed to st_malloc free_blocks.");
+    if (pthread_key_create(&bcache->mag_key, st_bcache_mag_destroy) != 0) {
+        ST_ERROR("Failed to pthread_key_create mag_key, "
+                "too many live caches? [PTHREAD_KEYS_MAX: %d]",
+                PTHREAD_KEYS_MAX);
+        (void)pthread_mutex_destroy(&bcache->lock);
+        safe_st_free(bcache);
         goto ERR;
     }
-    for (i = 0; i < count; i++) {
-        bcache->free_blocks[i] = i;
+
+    if (bcache->opt.keyed) {
+        bcache->key_dict = st_bcache_create_key_dict(bcache);
+        if (bcache->key_dict == NULL) {
+            ST_ERROR("Failed to st_bcache_create_key_dict.");
+            goto ERR;
+        }
     }
-    bcache->num_free_blocks = count;
 
-    if (pthread_mutex_init(&bcache->lock, NULL) != 0) {
-        ST_ERROR("Failed to pthread_mutex_init lock.");
+    if (st_bcache_add_pool(bcache,
+                bcache->opt.numa ? st_bcache_cur_node() : 0) < 0) {
+        ST_ERROR("Failed to st_bcache_add_pool.");
         goto ERR;
     }
 
@@ -87,114 +484,310 @@ ERR:
 
 void st_block_cache_destroy(st_block_cache_t* bcache)
 {
+    st_bcache_dir_t *dir;
+    st_bcache_mag_t *mag;
     size_t i;
 
     if (bcache == NULL) {
         return;
     }
 
-    if (bcache->data != NULL) {
-        for (i = 0; i < bcache->num_pools; i++) {
-            safe_st_free(bcache->data[i]);
+    // no thread may use the cache any more
+    (void)pthread_key_delete(bcache->mag_key);
+    while (bcache->mags != NULL) {
+        mag = bcache->mags;
+        bcache->mags = mag->next;
+        safe_st_free(mag);
+    }
+
+    for (i = 0; i < bcache->num_pools; i++) {
+        st_bcache_free_data(bcache, st_bcache_pool(bcache, i));
+        safe_st_free(st_bcache_pool(bcache, i)->ref_counts);
+        safe_st_free(st_bcache_pool(bcache, i)->keys);
+        safe_st_free(st_bcache_pool(bcache, i)->clock_bits);
+    }
+    safe_st_dict_destroy(bcache->key_dict);
+    if (bcache->dir != NULL) {
+        for (i = 0; i < bcache->dir->size; i++) {
+            safe_st_free(bcache->dir->leaves[i]);
         }
-        safe_st_free(bcache->data);
+    }
+    while (bcache->dir != NULL) {
+        dir = bcache->dir;
+        bcache->dir = dir->prev;
+        safe_st_free(dir);
     }
     bcache->num_pools = 0;
     bcache->block_size = 0;
     bcache->count = 0;
 
-    safe_st_free(bcache->ref_counts);
-    safe_st_free(bcache->free_blocks);
-    bcache->num_free_blocks = 0;
+    for (i = 0; i < ST_BCACHE_MAX_NODES; i++) {
+        safe_st_free(bcache->nodes[i].free_blocks);
+        bcache->nodes[i].num_free_blocks = 0;
+        bcache->nodes[i].max_free_blocks = 0;
+    }
 
     (void)pthread_mutex_destroy(&bcache->lock);
 }
 
 bcache_id_t st_block_cache_capacity(st_block_cache_t* bcache)
 {
-    return bcache->num_pools * bcache->count;
+    return __atomic_load_n(&bcache->num_pools, __ATOMIC_ACQUIRE)
+        * bcache->count;
 }
 
 bcache_id_t st_block_cache_size(st_block_cache_t* bcache)
 {
-    return st_block_cache_capacity(bcache) - bcache->num_free_blocks;
+    st_bcache_mag_t *mag;
+    bcache_id_t size;
+    int n;
+
+    (void)pthread_mutex_lock(&bcache->lock);
+    size = st_block_cache_capacity(bcache);
+    for (n = 0; n < ST_BCACHE_MAX_NODES; n++) {
+        size -= bcache->nodes[n].num_free_blocks;
+    }
+    for (mag = bcache->mags; mag != NULL; mag = mag->next) {
+        size -= __atomic_load_n(&mag->num, __ATOMIC_RELAXED);
+    }
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    return size;
 }
 
 int st_block_cache_clear(st_block_cache_t* bcache)
 {
+    st_bcache_mag_t *mag;
     bcache_id_t capacity;
     bcache_id_t i;
+    size_t p;
+    int n;
 
+    (void)pthread_mutex_lock(&bcache->lock);
     capacity = st_block_cache_capacity(bcache);
 
-    memset(bcache->ref_counts, 0, sizeof(bcache_id_t) * capacity);
+    for (p = 0; p < bcache->num_pools; p++) {
+        st_bcache_pool(bcache, p)->num_free = 0;
+        memset(st_bcache_pool(bcache, p)->ref_counts, 0,
+                sizeof(bcache_id_t) * bcache->count);
+        if (bcache->opt.keyed) {
+            memset(st_bcache_pool(bcache, p)->keys, 0,
+                    sizeof(uint64_t) * bcache->count);
+            memset(st_bcache_pool(bcache, p)->clock_bits, 0,
+                    sizeof(uint8_t) * bcache->count);
+        }
+    }
+    if (bcache->key_dict != NULL) {
+        safe_st_dict_destroy(bcache->key_dict);
+        bcache->key_dict = st_bcache_create_key_dict(bcache);
+        if (bcache->key_dict == NULL) {
+            ST_ERROR("Failed to st_bcache_create_key_dict.");
+            (void)pthread_mutex_unlock(&bcache->lock);
+            return -1;
+        }
+    }
+    bcache->clock_hand = 0;
+
+    for (n = 0; n < ST_BCACHE_MAX_NODES; n++) {
+        bcache->nodes[n].num_free_blocks = 0;
+    }
+    for (i = capacity - 1; i >= 0; i--) {
+        st_bcache_push_free(bcache, i);
+    }
 
-    for (i = 0; i < capacity; i++) {
-        bcache->free_blocks[i] = i;
+    for (mag = bcache->mags; mag != NULL; mag = mag->next) {
+        __atomic_store_n(&mag->num, 0, __ATOMIC_RELAXED);
     }
-    bcache->num_free_blocks = capacity;
+    (void)pthread_mutex_unlock(&bcache->lock);
 
     return 0;
 }
 
+#define st_bcache_ref_count(bcache, block_id) \
+    (st_bcache_pool(bcache, (block_id) / (bcache)->count)->ref_counts \
+     + (block_id) % (bcache)->count)
+
+#define st_bcache_key_node(node, key) do { \
+    (node).sign1 = (st_dict_sign_t)(key); \
+    (node).sign2 = (st_dict_sign_t)((key) >> 32); \
+} while (0)
+
+/*
+ * CLOCK: the hand sweeps the blocks, skipping the ones in use or without
+ * a key. A recently used block loses its clock bit and is passed over
+ * once; the first one found without it is evicted into the free blocks.
+ */
 // should hold the lock outside this function
-static bcache_id_t st_bcache_get_free_block(st_block_cache_t *bcache)
+static int st_bcache_evict(st_block_cache_t *bcache)
 {
-    bcache_id_t cur_capacity;
-    bcache_id_t i;
+    st_bcache_pool_t *pool;
+    st_dict_node_t snode;
+    bcache_id_t capacity;
+    bcache_id_t step;
+    bcache_id_t id, i;
+
+    if (!bcache->opt.keyed) {
+        return -1;
+    }
 
-    if (bcache->num_free_blocks <= 0) {
-        cur_capacity = st_block_cache_capacity(bcache);
+    capacity = st_block_cache_capacity(bcache);
+    for (step = 0; step < 2 * capacity; step++) {
+        id = bcache->clock_hand;
+        bcache->clock_hand = (id + 1) % capacity;
 
-        bcache->data = (void **)st_realloc(bcache->data, sizeof(void *)
-                * (bcache->num_pools + 1));
-        if (bcache->data == NULL) {
-            ST_ERROR("Failed to st_realloc data.");
-            return -1;
+        pool = st_bcache_pool(bcache, id / bcache->count);
+        i = id % bcache->count;
+        if (pool->keys[i] == 0
+                || __atomic_load_n(pool->ref_counts + i, __ATOMIC_ACQUIRE) > 0) {
+            continue;
+        }
+        if (pool->clock_bits[i]) {
+            pool->clock_bits[i] = 0;
+            continue;
         }
-        bcache->num_pools += 1;
 
-        bcache->data[bcache->num_pools - 1] = (void *)st_malloc(
-                bcache->block_size * bcache->count);
-        if (bcache->data[bcache->num_pools - 1] == NULL) {
-            ST_ERROR("Failed to st_malloc data buffer.");
+        st_bcache_key_node(snode, pool->keys[i]);
+        if (st_dict_delete(bcache->key_dict, &snode, NULL) < 0) {
+            ST_ERROR("Failed to st_dict_delete key_dict.");
             return -1;
         }
+        pool->keys[i] = 0;
+        st_bcache_push_free(bcache, id);
+
+        return 0;
+    }
+
+    return -1;
+}
+
+// node to refill a magazine of node from, prefering node itself
+static st_bcache_node_t* st_bcache_refill_node(st_block_cache_t *bcache,
+        int node)
+{
+    int n;
+
+    if (bcache->nodes[node].num_free_blocks > 0) {
+        return bcache->nodes + node;
+    }
+    for (n = 0; n < ST_BCACHE_MAX_NODES; n++) {
+        if (bcache->nodes[n].num_free_blocks > 0) {
+            return bcache->nodes + n;
+        }
+    }
+
+    if (bcache->num_pools >= bcache->max_pools) {
+        if (st_bcache_evict(bcache) < 0) {
+            ST_ERROR("Block cache full, nothing to evict.");
+            return NULL;
+        }
+        return st_bcache_refill_node(bcache, node);
+    }
+
+    if (st_bcache_add_pool(bcache, node) < 0) {
+        ST_ERROR("Failed to st_bcache_add_pool.");
+        return NULL;
+    }
+
+    return bcache->nodes + node;
+}
+
+// one free id straight from the free_blocks, -1 if none can be made
+// should hold the lock outside this function
+static bcache_id_t st_bcache_take_free(st_block_cache_t *bcache)
+{
+    st_bcache_node_t *free_node;
+    bcache_id_t id;
+
+    free_node = st_bcache_refill_node(bcache,
+            bcache->opt.numa ? st_bcache_cur_node() : 0);
+    if (free_node == NULL) {
+        ST_ERROR("Failed to st_bcache_refill_node.");
+        return -1;
+    }
+    if (st_bcache_pop_free(bcache, free_node, &id, 1) < 0) {
+        ST_ERROR("Failed to st_bcache_pop_free.");
+        return -1;
+    }
+
+    return id;
+}
+
+static bcache_id_t st_bcache_get_free_block(st_block_cache_t *bcache)
+{
+    st_bcache_node_t *free_node;
+    st_bcache_mag_t *mag;
+    bcache_id_t num;
 
-        bcache->ref_counts = (bcache_id_t *)st_realloc(bcache->ref_counts,
-            sizeof(bcache_id_t) * (cur_capacity + bcache->count));
-        if (bcache->ref_counts == NULL) {
-            ST_ERROR("Failed to st_realloc ref_counts.");
+    // eviction only sees the free_blocks, keep no free id in magazines
+    if (bcache->opt.keyed) {
+        if (pthread_mutex_lock(&bcache->lock) != 0) {
+            ST_ERROR("Failed to pthread_mutex_lock lock.");
             return -1;
         }
-        memset(bcache->ref_counts + cur_capacity, 0,
-                sizeof(bcache_id_t) * bcache->count);
+        num = st_bcache_take_free(bcache);
+        (void)pthread_mutex_unlock(&bcache->lock);
+        return num;
+    }
+
+    mag = st_bcache_get_mag(bcache);
+    if (mag == NULL) {
+        ST_ERROR("Failed to st_bcache_get_mag.");
+        return -1;
+    }
 
-        bcache->free_blocks = (bcache_id_t *)st_realloc(bcache->free_blocks,
-            sizeof(bcache_id_t) * (cur_capacity + bcache->count));
-        if (bcache->free_blocks == NULL) {
-            ST_ERROR("Failed to st_realloc free_blocks.");
+    if (mag->num <= 0) {
+        if (pthread_mutex_lock(&bcache->lock) != 0) {
+            ST_ERROR("Failed to pthread_mutex_lock lock.");
             return -1;
         }
-        for (i = 0; i < bcache->count; i++) {
-            bcache->free_blocks[i] = i + cur_capacity;
+        free_node = st_bcache_refill_node(bcache, mag->node);
+        if (free_node == NULL) {
+            ST_ERROR("Failed to st_bcache_refill_node.");
+            (void)pthread_mutex_unlock(&bcache->lock);
+            return -1;
+        }
+        num = min(free_node->num_free_blocks, ST_BCACHE_MAG_BATCH);
+        if (st_bcache_pop_free(bcache, free_node, mag->ids, num) < 0) {
+            ST_ERROR("Failed to st_bcache_pop_free.");
+            (void)pthread_mutex_unlock(&bcache->lock);
+            return -1;
         }
-        bcache->num_free_blocks = bcache->count;
+        __atomic_store_n(&mag->num, num, __ATOMIC_RELAXED);
+        (void)pthread_mutex_unlock(&bcache->lock);
     }
 
-    return bcache->free_blocks[--bcache->num_free_blocks];
+    num = mag->num - 1;
+    __atomic_store_n(&mag->num, num, __ATOMIC_RELAXED);
+
+    return mag->ids[num];
 }
 
-// should hold the lock outside this function
 static int st_bcache_return_block(st_block_cache_t *bcache,
         bcache_id_t block_id)
 {
-    bcache->free_blocks[bcache->num_free_blocks++] = block_id;
+    st_bcache_mag_t *mag;
+
+    mag = st_bcache_get_mag(bcache);
+    if (mag == NULL) {
+        ST_ERROR("Failed to st_bcache_get_mag.");
+        return -1;
+    }
+
+    if (mag->num >= ST_BCACHE_MAG_SIZE) {
+        if (pthread_mutex_lock(&bcache->lock) != 0) {
+            ST_ERROR("Failed to pthread_mutex_lock lock.");
+            return -1;
+        }
+        st_bcache_spill(bcache, mag, ST_BCACHE_MAG_BATCH);
+        (void)pthread_mutex_unlock(&bcache->lock);
+    }
+
+    mag->ids[mag->num] = block_id;
+    __atomic_store_n(&mag->num, mag->num + 1, __ATOMIC_RELAXED);
 
     return 0;
 }
 
-// should hold the lock outside this function
 static void* st_bcache_get_block(st_block_cache_t *bcache,
         bcache_id_t block_id)
 {
@@ -203,129 +796,229 @@ static void* st_bcache_get_block(st_block_cache_t *bcache,
     p = block_id / bcache->count;
     i = block_id % bcache->count;
 
-    return bcache->data[p] + (bcache->block_size * i);
+    return st_bcache_pool_data(st_bcache_pool(bcache, p))
+        + (bcache->block_size * i);
 }
 
 void* st_block_cache_fetch(st_block_cache_t* bcache, bcache_id_t *block_id)
 {
-    void *ret;
-
     ST_CHECK_PARAM(bcache == NULL || block_id == NULL
             , NULL);
 
-    if (pthread_mutex_lock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_lock lock.");
-        return NULL;
-    }
     if (*block_id >= st_block_cache_capacity(bcache)) {
         ST_ERROR("Invalid block_id["BCACHE_ID_FMT".", *block_id);
-        goto ERR;
+        return NULL;
+    }
+
+    if (*block_id >= 0 && st_bcache_pool_data(st_bcache_pool(bcache,
+                    *block_id / bcache->count)) == NULL) {
+        ST_ERROR("block["BCACHE_ID_FMT"] is trimmed.", *block_id);
+        return NULL;
     }
 
     if (*block_id < 0) {
         *block_id = st_bcache_get_free_block(bcache);
         if (*block_id < 0) {
             ST_ERROR("Failed to st_bcache_get_free_block.");
-            goto ERR;
+            return NULL;
         }
+    } else if (bcache->opt.keyed) {
+        // must not race with eviction
+        (void)pthread_mutex_lock(&bcache->lock);
+        (void)__atomic_add_fetch(st_bcache_ref_count(bcache, *block_id), 1,
+                __ATOMIC_ACQ_REL);
+        st_bcache_pool(bcache, *block_id / bcache->count)->clock_bits[
+            *block_id % bcache->count] = 1;
+        (void)pthread_mutex_unlock(&bcache->lock);
+
+        return st_bcache_get_block(bcache, *block_id);
     }
 
-    bcache->ref_counts[*block_id]++;
+    (void)__atomic_add_fetch(st_bcache_ref_count(bcache, *block_id), 1,
+            __ATOMIC_ACQ_REL);
+
+    return st_bcache_get_block(bcache, *block_id);
+}
+
+void* st_block_cache_fetch_key(st_block_cache_t* bcache, uint64_t key,
+        bcache_id_t *block_id, bool *found)
+{
+    st_bcache_pool_t *pool;
+    st_dict_node_t snode;
+    bcache_id_t id;
 
-    ret = st_bcache_get_block(bcache, *block_id);
+    ST_CHECK_PARAM(bcache == NULL || key == 0 || block_id == NULL
+            || !bcache->opt.keyed, NULL);
 
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
+    if (pthread_mutex_lock(&bcache->lock) != 0) {
+        ST_ERROR("Failed to pthread_mutex_lock lock.");
         return NULL;
     }
 
-    return ret;
+    st_bcache_key_node(snode, key);
+    if (st_dict_seek(bcache->key_dict, &snode, NULL) >= 0) {
+        id = (bcache_id_t)snode.uint1;
+        pool = st_bcache_pool(bcache, id / bcache->count);
+        if (found != NULL) {
+            *found = true;
+        }
+    } else {
+        id = st_bcache_take_free(bcache);
+        if (id < 0) {
+            ST_ERROR("Failed to st_bcache_take_free.");
+            goto ERR;
+        }
 
-ERR:
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
-        return NULL;
+        snode.uint1 = (unsigned int)id;
+        if (st_dict_add_no_seek(bcache->key_dict, &snode) < 0) {
+            ST_ERROR("Failed to st_dict_add_no_seek key_dict.");
+            st_bcache_push_free(bcache, id);
+            goto ERR;
+        }
+        pool = st_bcache_pool(bcache, id / bcache->count);
+        pool->keys[id % bcache->count] = key;
+        if (found != NULL) {
+            *found = false;
+        }
     }
+    (void)__atomic_add_fetch(pool->ref_counts + id % bcache->count, 1,
+            __ATOMIC_ACQ_REL);
+    pool->clock_bits[id % bcache->count] = 1;
+
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    *block_id = id;
+    return st_bcache_get_block(bcache, id);
+
+ERR:
+    (void)pthread_mutex_unlock(&bcache->lock);
     return NULL;
 }
 
-int st_block_cache_return(st_block_cache_t* bcache, bcache_id_t block_id)
+// blocks with a key stay resident until they are evicted
+static int st_bcache_return_keyed(st_block_cache_t *bcache,
+        bcache_id_t block_id)
 {
-    ST_CHECK_PARAM(bcache == NULL || block_id < 0, -1);
+    st_bcache_pool_t *pool;
+    bcache_id_t i;
 
     if (pthread_mutex_lock(&bcache->lock) != 0) {
         ST_ERROR("Failed to pthread_mutex_lock lock.");
         return -1;
     }
+
+    pool = st_bcache_pool(bcache, block_id / bcache->count);
+    i = block_id % bcache->count;
+    if (pool->ref_counts[i] <= 0) {
+        ST_ERROR("block[%d] double returned.", block_id);
+        (void)pthread_mutex_unlock(&bcache->lock);
+        return -1;
+    }
+    if (__atomic_sub_fetch(pool->ref_counts + i, 1, __ATOMIC_ACQ_REL) == 0
+            && pool->keys[i] == 0) {
+        st_bcache_push_free(bcache, block_id);
+    }
+
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    return 0;
+}
+
+int st_block_cache_return(st_block_cache_t* bcache, bcache_id_t block_id)
+{
+    bcache_id_t *ref_count;
+    bcache_id_t cnt;
+
+    ST_CHECK_PARAM(bcache == NULL || block_id < 0, -1);
+
     if (block_id >= st_block_cache_capacity(bcache)) {
         ST_ERROR("Invalid block_id["BCACHE_ID_FMT".", block_id);
-        goto ERR;
+        return -1;
     }
 
-    if (bcache->ref_counts[block_id] <= 0) {
-        ST_ERROR("block[%d] double returned.", block_id);
-        goto ERR;
+    if (bcache->opt.keyed) {
+        return st_bcache_return_keyed(bcache, block_id);
     }
 
-    bcache->ref_counts[block_id]--;
+    ref_count = st_bcache_ref_count(bcache, block_id);
+    cnt = __atomic_load_n(ref_count, __ATOMIC_RELAXED);
+    do {
+        if (cnt <= 0) {
+            ST_ERROR("block[%d] double returned.", block_id);
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(ref_count, &cnt, cnt - 1, true,
+                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
 
-    if (bcache->ref_counts[block_id] <= 0) {
+    if (cnt == 1) {
         if (st_bcache_return_block(bcache, block_id) < 0) {
             ST_ERROR("Failed to st_bcache_return_block.");
-            goto ERR;
+            return -1;
         }
     }
 
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
-        return -1;
-    }
-
     return 0;
-
-ERR:
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
-        return -1;
-    }
-    return -1;
 }
 
 void* st_block_cache_read(st_block_cache_t* bcache, bcache_id_t block_id)
 {
-    void *ret;
-
     ST_CHECK_PARAM(bcache == NULL || block_id < 0, NULL);
 
-    if (pthread_mutex_lock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_lock lock.");
-        return NULL;
-    }
-
     if (block_id >= st_block_cache_capacity(bcache)) {
         ST_ERROR("Invalid block_id["BCACHE_ID_FMT".", block_id);
-        goto ERR;
+        return NULL;
     }
 
-    if (bcache->ref_counts[block_id] <= 0) {
+    if (__atomic_load_n(st_bcache_ref_count(bcache, block_id),
+                __ATOMIC_ACQUIRE) <= 0) {
         ST_ERROR("block[%d] not in use.", block_id);
-        goto ERR;
+        return NULL;
     }
 
-    ret = st_bcache_get_block(bcache, block_id);
+    return st_bcache_get_block(bcache, block_id);
+}
+
+int st_block_cache_trim(st_block_cache_t* bcache)
+{
+    st_bcache_pool_t *pool;
+    st_bcache_mag_t *mag;
+    size_t p;
+    int n;
 
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
-        return NULL;
+    ST_CHECK_PARAM(bcache == NULL, -1);
+
+    if (pthread_mutex_lock(&bcache->lock) != 0) {
+        ST_ERROR("Failed to pthread_mutex_lock lock.");
+        return -1;
     }
 
-    return ret;
+    // free ids of the calling thread can be trimmed too
+    mag = (st_bcache_mag_t *)pthread_getspecific(bcache->mag_key);
+    if (mag != NULL) {
+        st_bcache_spill(bcache, mag, mag->num);
+    }
 
-ERR:
-    if (pthread_mutex_unlock(&bcache->lock) != 0) {
-        ST_ERROR("Failed to pthread_mutex_unlock lock.");
-        return NULL;
+    n = 0;
+    for (p = 0; p < bcache->num_pools; p++) {
+        pool = st_bcache_pool(bcache, p);
+        if (pool->num_free < bcache->count || pool->trimmed) {
+            continue;
+        }
+
+        if (bcache->mmap_pools) {
+            // pages are given back, and read as zeros when touched again
+            if (madvise(pool->data, bcache->pool_len, MADV_DONTNEED) != 0) {
+                ST_WARNING("Failed to madvise MADV_DONTNEED.");
+                continue;
+            }
+        } else {
+            st_bcache_free_data(bcache, pool);
+        }
+        pool->trimmed = true;
+        n++;
     }
 
-    return NULL;
+    (void)pthread_mutex_unlock(&bcache->lock);
+
+    return n;
 }
@@ -30,10 +30,12 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <stutils/st_macro.h>
 #include "st_mem.h"
+#include "st_dict.h"
 
 /** @defgroup g_block_cache Block Memory Cache
  * Cache for blocks of memory. Store a series of memory block with fixed size,
@@ -44,26 +46,132 @@ extern "C" {
 #define bcache_id_t int32_t
 #define BCACHE_ID_FMT "%d"
 
+/**
+ * Pools are found through a two-level directory: an array of leaves, each
+ * holding ST_BCACHE_DIR_SIZE pools. Leaves are allocated as pools are added
+ * and never move. The array doubles when it is full; the old ones are kept
+ * until the cache is destroyed, so readers holding them stay valid.
+ */
+#define ST_BCACHE_DIR_SHIFT 8
+#define ST_BCACHE_DIR_SIZE  (1 << ST_BCACHE_DIR_SHIFT)
+
+/** size of a huge page, pools are rounded up to it with huge pages. */
+#define ST_BCACHE_HUGE_PAGE_SIZE (2UL << 20)
+
+/** max number of NUMA nodes a block cache spreads its pools over. */
+#define ST_BCACHE_MAX_NODES 64
+
+/**
+ * data buffer pool
+ * @ingroup g_block_cache
+ */
+typedef struct _st_bcache_pool_t_
+{
+    void *data; /**< data buffer of count blocks. */
+    bcache_id_t *ref_counts; /**< ref_count for blocks. */
+    int node; /**< NUMA node the data buffer is bound to. */
+    uint64_t *keys; /**< key of every block, 0 for none, in keyed mode. */
+    uint8_t *clock_bits; /**< blocks used since the clock hand passed. */
+    bcache_id_t num_free; /**< blocks of the pool in free_blocks. */
+    bool trimmed; /**< memory given back by st_block_cache_trim. */
+} st_bcache_pool_t;
+
+/**
+ * leaves of pools
+ * @ingroup g_block_cache
+ */
+typedef struct _st_bcache_dir_t_
+{
+    struct _st_bcache_dir_t_ *prev; /**< smaller array it replaced. */
+    size_t size; /**< number of leaves. */
+    st_bcache_pool_t *leaves[]; /**< ST_BCACHE_DIR_SIZE pools each. */
+} st_bcache_dir_t;
+
+/**
+ * free blocks of the pools on one NUMA node
+ * @ingroup g_block_cache
+ */
+typedef struct _st_bcache_node_t_
+{
+    bcache_id_t *free_blocks; /**< record the ids of free block. */
+    bcache_id_t num_free_blocks; /**< number of free blocks. */
+    bcache_id_t max_free_blocks; /**< blocks in the pools of the node. */
+} st_bcache_node_t;
+
+/**
+ * Options for st_block_cache_create_ex. huge_pages, hugetlb and numa back
+ * the pools with anonymous mmap instead of st_malloc.
+ *
+ * In keyed mode, blocks fetched with st_block_cache_fetch_key keep their
+ * key and content when their ref count drops to zero, and are found again
+ * by key until they are evicted. Eviction only happens when no free block
+ * is left and max_blocks is reached, and picks an unreferenced keyed block
+ * by CLOCK. Keyed operations, fetch and return take the lock and bypass
+ * the magazines, so every free block can be found by eviction; read stays
+ * wait-free.
+ * @ingroup g_block_cache
+ */
+typedef struct _st_block_cache_opt_t_
+{
+    bool keyed; /**< enable st_block_cache_fetch_key and eviction. */
+    /** bound on the number of blocks, rounded up to count, 0 for none. */
+    bcache_id_t max_blocks;
+    /**
+     * madvise(MADV_HUGEPAGE) on every pool. Pools are rounded up to
+     * ST_BCACHE_HUGE_PAGE_SIZE, so block_size * count should be close to
+     * a multiple of it.
+     */
+    bool huge_pages;
+    /** map pools from hugetlbfs, else as huge_pages. Rounded the same. */
+    bool hugetlb;
+    /**
+     * bind every pool to the NUMA node of the thread adding it, and
+     * refill magazines from pools of the thread's own node first.
+     */
+    bool numa;
+} st_block_cache_opt_t;
+
+struct _st_bcache_mag_t_;
+
 /**
  * block memory cache
+ *
+ * Fetch, return and read may be called from any number of threads. Each
+ * thread fetches from and returns to its own magazine of free block ids,
+ * and only takes the lock to exchange a batch of ids with the free_blocks
+ * of a node.
+ * Ref counts are updated atomically and pools never move, so read is
+ * wait-free: it loads num_pools, the directory, a leaf and the ref count.
  * @ingroup g_block_cache
  */
 typedef struct _st_block_cache_t_
 {
-    void **data; /**< data buffer pool. */
+    st_bcache_dir_t *dir; /**< leaves of pools. */
     size_t num_pools; /**< numberof data buffer pools. */
     size_t block_size; /**< size of block. */
     bcache_id_t count; /**< count of blocks in one data buffer. */
 
-    bcache_id_t *ref_counts; /**< ref_count for blocks. */
-    bcache_id_t *free_blocks; /**< record the ids of free block. */
-    bcache_id_t num_free_blocks; /**< number of free blocks. */
+    st_bcache_node_t nodes[ST_BCACHE_MAX_NODES]; /**< free blocks. */
+
+    st_block_cache_opt_t opt; /**< options. */
+    size_t max_pools; /**< number of pools allowed by max_blocks. */
+    bool mmap_pools; /**< pools are mapped, pool_len bytes each. */
+    size_t pool_len; /**< mapped length of a pool. */
+
+    st_dict_t *key_dict; /**< key to block id, in keyed mode. */
+    bcache_id_t clock_hand; /**< next block the eviction looks at. */
+
+    pthread_key_t mag_key; /**< magazine of the calling thread. */
+    struct _st_bcache_mag_t_ *mags; /**< magazines of all threads. */
 
     pthread_mutex_t lock; /**< mutex. */
 } st_block_cache_t;
 
 /**
  * Create a block memory cache.
+ * Every cache holds a pthread key for the magazines until it is destroyed,
+ * so at most PTHREAD_KEYS_MAX (1024 on glibc) caches, less the keys used
+ * elsewhere in the process, can live at the same time.
  * @ingroup g_block_cache
  * @param[in] block_size size of each block.
  * @param[in] count count of blocks, maybe extend by multiplies of it.
@@ -71,6 +179,18 @@ typedef struct _st_block_cache_t_
  */
 st_block_cache_t* st_block_cache_create(size_t block_size, bcache_id_t count);
 
+/**
+ * Create a block memory cache with options. The limit on live caches of
+ * st_block_cache_create applies.
+ * @ingroup g_block_cache
+ * @param[in] block_size size of each block.
+ * @param[in] count count of blocks, maybe extend by multiplies of it.
+ * @param[in] opt options, NULL for default values.
+ * @return block_cache on success, otherwise NULL.
+ */
+st_block_cache_t* st_block_cache_create_ex(size_t block_size,
+        bcache_id_t count, const st_block_cache_opt_t *opt);
+
 /**
  * Destroy a block cache and set the pointer to NULL.
  * @ingroup g_block_cache
@@ -84,7 +204,7 @@ st_block_cache_t* st_block_cache_create(size_t block_size, bcache_id_t count);
     }\
     } while(0)
 /**
- * Destroy a block cache.
+ * Destroy a block cache. No other thread may use it any more.
  * @ingroup g_block_cache
  * @param[in] bcache cache to be destroyed.
  */
@@ -107,7 +227,7 @@ bcache_id_t st_block_cache_capacity(st_block_cache_t* bcache);
 bcache_id_t st_block_cache_size(st_block_cache_t* bcache);
 
 /**
- * Clear all content of a block cache.
+ * Clear all content of a block cache. Must not race with fetch or return.
  * @ingroup g_block_cache
  * @param[in] bcache the block cache
  * @return non-zero value if any error.
@@ -125,6 +245,20 @@ int st_block_cache_clear(st_block_cache_t* bcache);
  */
 void* st_block_cache_fetch(st_block_cache_t* bcache, bcache_id_t *block_id);
 
+/**
+ * Fetch the block of key from a keyed block cache. If key is not resident,
+ * a free block is taken, evicting an unreferenced one if needed, and
+ * associated with key; its content is then up to the caller.
+ * @ingroup g_block_cache
+ * @param[in] bcache the block cache
+ * @param[in] key key of the block, must not be 0.
+ * @param[out] block_id id for the block in cache.
+ * @param[out] found whether the block was resident, may be NULL.
+ * @return pointer to the fetched block, NULL if any error.
+ */
+void* st_block_cache_fetch_key(st_block_cache_t* bcache, uint64_t key,
+        bcache_id_t *block_id, bool *found);
+
 /**
  * Return a block to block cache.
  * @ingroup g_block_cache
@@ -135,7 +269,8 @@ void* st_block_cache_fetch(st_block_cache_t* bcache, bcache_id_t *block_id);
 int st_block_cache_return(st_block_cache_t* bcache, bcache_id_t block_id);
 
 /**
- * Read a block in block cache.
+ * Read a block in block cache. Wait-free, fails if the block is not
+ * fetched by anyone.
  * @ingroup g_block_cache
  * @param[in] bcache the block cache
  * @param[in, out] block_id id for the block in cache.
@@ -143,6 +278,17 @@ int st_block_cache_return(st_block_cache_t* bcache, bcache_id_t block_id);
  */
 void* st_block_cache_read(st_block_cache_t* bcache, bcache_id_t block_id);
 
+/**
+ * Give back the memory of every pool whose blocks are all free. Mapped
+ * pools are madvise(MADV_DONTNEED)'ed in place, other ones are freed and
+ * allocated again when one of their blocks is fetched. Free blocks in the
+ * magazines of other threads keep their pools alive. Costs O(pools).
+ * @ingroup g_block_cache
+ * @param[in] bcache the block cache
+ * @return number of pools trimmed, -1 if any error.
+ */
+int st_block_cache_trim(st_block_cache_t* bcache);
+
 #ifdef __cplusplus
 }
 #endif
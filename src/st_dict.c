@@ -24,6 +24,15 @@
 
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <stutils/st_macro.h>
 #include "st_utils.h"
 #include "st_log.h"
@@ -35,17 +44,131 @@ void st_dict_destroy(st_dict_t *wd)
         return;
     }
 
+    if (wd->read_only) {
+        wd->first_level_node = NULL;
+        wd->node_pool = NULL;
+        wd->ctrl = NULL;
+    }
+
+    if (wd->map_addr != NULL) {
+        (void)munmap(wd->map_addr, wd->map_len);
+        wd->map_addr = NULL;
+        wd->map_len = 0;
+    }
+
     if(wd->first_level_node) {
-        safe_st_free(wd->first_level_node);
+        safe_st_aligned_free(wd->first_level_node);
     }
 
     if(wd->node_pool) {
-        safe_st_free(wd->node_pool);
+        safe_st_aligned_free(wd->node_pool);
     }
 
     if(wd->clear_nodes) {
         safe_st_free(wd->clear_nodes);
     }
+
+    safe_st_free(wd->ctrl);
+    safe_st_aligned_free(wd->old_first_level_node);
+
+    (void)st_dict_reclaim(wd);
+}
+
+/*
+ * Node arrays.
+ *
+ * Nodes are node_size apart, which is larger than sizeof(st_dict_node_t)
+ * when they carry a value, so they must be addressed with st_dict_at. The
+ * arrays are aligned to ST_DICT_ALIGN, and freed with st_aligned_free.
+ */
+#define st_dict_align(sz) (((sz) + ST_DICT_ALIGN - 1) \
+        & ~((size_t)ST_DICT_ALIGN - 1))
+
+#define st_dict_at(wd, nodes, i) ((st_dict_node_t *)((char *)(nodes) \
+            + (size_t)(i) * (wd)->node_size))
+
+#define st_dict_id_of(wd, nodes, node) ((st_dict_id_t)(((char *)(node) \
+            - (char *)(nodes)) / (wd)->node_size))
+
+// stride of nodes carrying value_size bytes
+static size_t st_dict_node_size(size_t value_size)
+{
+    size_t sz;
+
+    if (value_size == 0) {
+        return sizeof(st_dict_node_t);
+    }
+
+    sz = sizeof(st_dict_node_t) + value_size;
+    if (sz > ST_DICT_ALIGN) {
+        return st_dict_align(sz);
+    }
+
+    // a power of 2, so that no node straddles two cache lines
+    return (size_t)1 << (64 - __builtin_clzll(sz - 1));
+}
+
+/*
+ * Largest number of nodes in one array, so that neither the ids nor the size
+ * in bytes can overflow.
+ */
+static inline st_dict_id_t st_dict_max_num(size_t node_size)
+{
+    size_t n;
+
+    n = SIZE_MAX / node_size;
+    if (n < (size_t)(ST_DICT_BAD_NODE - 1)) {
+        return (st_dict_id_t)n;
+    }
+
+    return ST_DICT_BAD_NODE - 1;
+}
+
+static inline st_dict_node_t* st_dict_alloc_nodes(st_dict_t *wd,
+        st_dict_id_t num)
+{
+    return (st_dict_node_t *)st_aligned_malloc(
+            wd->node_size * (size_t)max(num, 1), ST_DICT_ALIGN);
+}
+
+// zero nodes[from, to)
+static void st_dict_reset_nodes(st_dict_t *wd, st_dict_node_t *nodes,
+        st_dict_id_t from, st_dict_id_t to)
+{
+    st_dict_id_t i;
+
+    memset(st_dict_at(wd, nodes, from), 0, wd->node_size * (size_t)(to - from));
+    for (i = from; i < to; i++) {
+        st_dict_at(wd, nodes, i)->next = ST_DICT_BAD_NODE;
+    }
+}
+
+// copy uint1 and the value of src to dst
+static inline void st_dict_copy_data(st_dict_t *wd, st_dict_node_t *dst,
+        const st_dict_node_t *src)
+{
+    dst->uint1 = src->uint1;
+    if (wd->value_size > 0) {
+        memcpy(dst + 1, src + 1, wd->value_size);
+    }
+}
+
+// highest_bit_mask for st_dict_id_t
+static st_dict_id_t st_dict_bit_mask(st_dict_id_t num, bool overflow)
+{
+    st_dict_id_t mask;
+
+    mask = overflow ? num : num >> 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+#ifdef _ST_DICT_64BIT_ID_
+    mask |= mask >> 32;
+#endif
+
+    return mask;
 }
 
 st_dict_id_t st_dict_hash_simple(st_dict_t *wd, st_dict_node_t *pnode)
@@ -63,490 +186,2352 @@ st_dict_id_t st_dict_hash_sign1(st_dict_t *wd, st_dict_node_t *pnode)
     return (pnode->sign1 & wd->addr_mask);
 }
 
+/*
+ * Mixed hashes of the 64-bit key sign1 << 32 | sign2. They are branch free,
+ * and every bit of the result depends on every bit of the key.
+ */
+#define st_dict_key(pnode) ((((uint64_t)(pnode)->sign1) << 32) \
+        | (pnode)->sign2)
+
+// finalizer of MurmurHash3
+static inline uint64_t st_dict_mix(st_dict_node_t *pnode)
+{
+    uint64_t h;
+
+    h = st_dict_key(pnode);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+st_dict_id_t st_dict_hash_fmix64(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    return ((st_dict_id_t)st_dict_mix(pnode)) & wd->addr_mask;
+}
+
+// rrmxmx, as used by XXH3 for 8-byte inputs
+st_dict_id_t st_dict_hash_xxh3(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    uint64_t h;
+
+    h = st_dict_key(pnode);
+    h ^= ((h << 49) | (h >> 15)) ^ ((h << 24) | (h >> 40));
+    h *= 0x9fb21c651e98df25ULL;
+    h ^= (h >> 35) + 8;
+    h *= 0x9fb21c651e98df25ULL;
+    h ^= h >> 28;
+
+    return ((st_dict_id_t)h) & wd->addr_mask;
+}
+
+static inline uint64_t st_dict_wymix(uint64_t a, uint64_t b)
+{
+    __uint128_t r;
+
+    r = (__uint128_t)a * b;
+
+    return (uint64_t)(r >> 64) ^ (uint64_t)r;
+}
+
+// wyhash-style: two rounds of 128-bit multiply and fold
+st_dict_id_t st_dict_hash_wyhash(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    uint64_t a;
+    uint64_t b;
+
+    a = (((uint64_t)pnode->sign1) << 32) | pnode->sign1;
+    b = (((uint64_t)pnode->sign2) << 32) | pnode->sign2;
+    a ^= 0xe7037ed1a0b428dbULL;
+    b ^= 0xa0761d6478bd642fULL;
+    return ((st_dict_id_t)st_dict_wymix(
+                st_dict_wymix(a, b) ^ 0xa0761d6478bd642fULL ^ 8,
+                0xe7037ed1a0b428dbULL)) & wd->addr_mask;
+}
+
 bool st_dict_node_equal(st_dict_node_t *node1, st_dict_node_t *node2,
     void *arg )
 {
     return ((node1->sign1 == node2->sign1) && (node1->sign2 == node2->sign2));
 }
 
-static st_dict_t* st_dict_alloc()
-{
-    st_dict_t *wd;
+/*
+ * Open addressing engine.
+ *
+ * Slots live in first_level_node, ctrl[i] describes slot i: EMPTY, DELETED
+ * or a full slot holding the 7-bit h2 of its node. ctrl has
+ * ST_DICT_GROUP_WIDTH extra bytes mirroring the first ones, so that a group
+ * can be loaded from any position without wrapping. Groups are probed
+ * triangularly, which visits every group as hash_num is a power of 2.
+ */
+#define ST_DICT_GROUP_WIDTH  16
+#define ST_DICT_CTRL_EMPTY   ((unsigned char)0x80)
+#define ST_DICT_CTRL_DELETED ((unsigned char)0xFE)
 
-    wd = (st_dict_t *)st_malloc(sizeof(st_dict_t));
-    if(wd == NULL)
-    {
-        ST_ERROR("Failed to alloc mem for st_dict.");
-        return NULL;
-    }
-    memset(wd, 0, sizeof(st_dict_t));
+#define st_dict_ctrl_is_full(c) (((c) & 0x80) == 0)
 
-    return wd;
+static inline unsigned char st_dict_h2(st_dict_node_t *pnode)
+{
+    return (unsigned char)(st_dict_mix(pnode) >> 57);
 }
 
-st_dict_t* st_dict_create(st_dict_id_t hash_num,
-    st_dict_id_t realloc_node_num, st_dict_hash_fun_t hash_func,
-    st_dict_node_eq_fun_t node_eq_func, bool need_clear)
+#ifdef __SSE2__
+static inline unsigned int st_dict_group_match(const unsigned char *ctrl,
+        unsigned char h2)
 {
-    st_dict_t      *wd;
-    st_dict_id_t   i;
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
 
-    ST_CHECK_PARAM(hash_num == ST_DICT_BAD_NODE
-            || realloc_node_num == ST_DICT_BAD_NODE, NULL);
+    return (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
 
-    wd = (st_dict_t *)st_malloc(sizeof(st_dict_t));
-    if(wd == NULL)
-    {
-        ST_ERROR("Failed to alloc mem for st_dict.");
-        return NULL;
-    }
-    bzero(wd, sizeof(st_dict_t));
-    wd->realloc_node_num = realloc_node_num;
-    if(hash_func)
-    {
-        wd->hash_func = hash_func;
-    }
-    else
-    {
-        wd->hash_func = st_dict_hash_simple;
-    }
-    if(node_eq_func)
-    {
-        wd->node_eq_func = node_eq_func;
-    }
-    else
-    {
-        wd->node_eq_func = st_dict_node_equal;
-    }
+static inline unsigned int st_dict_group_match_free(const unsigned char *ctrl)
+{
+    // EMPTY and DELETED are the only ctrls with the high bit set
+    return (unsigned int)_mm_movemask_epi8(
+            _mm_loadu_si128((const __m128i *)ctrl));
+}
+#else
+static inline unsigned int st_dict_group_match(const unsigned char *ctrl,
+        unsigned char h2)
+{
+    unsigned int mask = 0;
+    int i;
 
-    wd->addr_mask = highest_bit_mask(hash_num, false);
-    wd->hash_num = wd->addr_mask + 1;
-    //ST_DEBUG("num=%d(0x%x), mask=0x%x, num=%d(0x%x)", hash_num, hash_num,
-        //wd->addr_mask, wd->hash_num, wd->hash_num);
-    wd->first_level_node = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t) * wd->hash_num);
-    if(wd->first_level_node == NULL)
-    {
-        ST_ERROR("Failed to alloc mem for first_level_node.");
-        goto FAILED;
+    for (i = 0; i < ST_DICT_GROUP_WIDTH; i++) {
+        if (ctrl[i] == h2) {
+            mask |= 1u << i;
+        }
     }
 
-    wd->node_pool = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t)*wd->hash_num);
-    if(wd->node_pool == NULL)
-    {
-        ST_ERROR("Failed to alloc mem for node_pool.");
-        goto FAILED;
-    }
+    return mask;
+}
 
-    if(need_clear)
-    {
-        wd->clear_nodes = (st_dict_id_t *)
-            st_malloc(sizeof(st_dict_id_t)*wd->hash_num);
-        if(wd->clear_nodes == NULL)
-        {
-            ST_ERROR("Failed to alloc mem for clear_nodes.");
-            goto FAILED;
+static inline unsigned int st_dict_group_match_free(const unsigned char *ctrl)
+{
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < ST_DICT_GROUP_WIDTH; i++) {
+        if (!st_dict_ctrl_is_full(ctrl[i])) {
+            mask |= 1u << i;
         }
-        wd->clear_node_num = 0;
     }
 
-    for(i = 0; i < wd->hash_num; i++)
-    {
-        wd->first_level_node[i].sign1 = 0;
-        wd->first_level_node[i].sign2 = 0;
-        wd->first_level_node[i].uint1 = 0;
-        wd->first_level_node[i].next = ST_DICT_BAD_NODE;
+    return mask;
+}
+#endif
 
-        wd->node_pool[i].sign1 = 0;
-        wd->node_pool[i].sign2 = 0;
-        wd->node_pool[i].uint1 = 0;
-        wd->node_pool[i].next = ST_DICT_BAD_NODE;
+#define st_dict_group_match_empty(ctrl) \
+    st_dict_group_match(ctrl, ST_DICT_CTRL_EMPTY)
+
+static inline void st_dict_set_ctrl(st_dict_t *wd, st_dict_id_t i,
+        unsigned char c)
+{
+    wd->ctrl[i] = c;
+    if (i < ST_DICT_GROUP_WIDTH) {
+        wd->ctrl[i + wd->hash_num] = c;
     }
-    wd->node_num = 0;
-    wd->max_pool_num = wd->hash_num;
-    wd->cur_index = 0;
+}
 
-    return wd;
+static st_dict_node_t* st_dict_open_find(st_dict_t *wd,
+        st_dict_node_t *pnode, void *node_eq_arg)
+{
+    st_dict_node_t *work;
+    st_dict_id_t pos;
+    st_dict_id_t step;
+    unsigned int match;
+    unsigned char h2;
+
+    h2 = st_dict_h2(pnode);
+    pos = wd->hash_func(wd, pnode);
+    step = 0;
+    while (true) {
+        match = st_dict_group_match(wd->ctrl + pos, h2);
+        while (match != 0) {
+            work = st_dict_at(wd, wd->first_level_node,
+                    (pos + __builtin_ctz(match)) & wd->addr_mask);
+            if (wd->node_eq_func(work, pnode, node_eq_arg)) {
+                return work;
+            }
+            match &= match - 1;
+        }
 
-FAILED:
-    safe_st_dict_destroy(wd);
-    return NULL;
+        if (st_dict_group_match_empty(wd->ctrl + pos) != 0) {
+            return NULL;
+        }
+
+        step += ST_DICT_GROUP_WIDTH;
+        if (step > wd->hash_num) {
+            return NULL;
+        }
+        pos = (pos + step) & wd->addr_mask;
+    }
 }
 
-static st_dict_id_t st_dict_add_in(st_dict_t *wd, st_dict_node_t *pnode)
+static st_dict_id_t st_dict_open_find_free(st_dict_t *wd, st_dict_id_t pos)
 {
-    st_dict_node_t *node;
+    st_dict_id_t step;
+    unsigned int match;
+
+    step = 0;
+    while (true) {
+        match = st_dict_group_match_free(wd->ctrl + pos);
+        if (match != 0) {
+            return (pos + __builtin_ctz(match)) & wd->addr_mask;
+        }
 
-    if(wd->cur_index >= wd->max_pool_num)
-    {
-        wd->node_pool = (st_dict_node_t *)st_realloc(wd->node_pool,
-            (wd->max_pool_num + wd->realloc_node_num)*sizeof(st_dict_node_t));
-        if(wd->node_pool == NULL)
-        {
-            ST_ERROR("Realloc node_pool failed.");
+        step += ST_DICT_GROUP_WIDTH;
+        if (step > wd->hash_num) {
             return ST_DICT_BAD_NODE;
         }
-        bzero(wd->node_pool + wd->max_pool_num, wd->realloc_node_num*sizeof(st_dict_node_t));
-
-        wd->max_pool_num += wd->realloc_node_num;
+        pos = (pos + step) & wd->addr_mask;
     }
-    node = &wd->node_pool[wd->cur_index];
-    node->sign1 = pnode->sign1;
-    node->sign2 = pnode->sign2;
-    node->uint1 = pnode->uint1;
-    node->next = ST_DICT_BAD_NODE;
-
-    return wd->cur_index++;
 }
 
-int st_dict_add(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg)
+// put pnode in a free slot, capacity must be checked by caller
+static st_dict_node_t* st_dict_open_put(st_dict_t *wd, st_dict_node_t *pnode)
 {
-    st_dict_id_t hash_key;
-    st_dict_id_t ret;
     st_dict_node_t *work;
+    st_dict_id_t i;
 
-    ST_CHECK_PARAM(pnode == NULL
-            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+    i = st_dict_open_find_free(wd, wd->hash_func(wd, pnode));
+    if (i == ST_DICT_BAD_NODE) {
+        ST_ERROR("No free slot in dict.");
+        return NULL;
+    }
 
-    if(st_dict_seek(wd, pnode, node_eq_arg)== 0)
-    {
-        ST_ERROR("node already exists");
-        return -1;
+    // a deleted slot is still in clear_nodes
+    if (wd->ctrl[i] == ST_DICT_CTRL_DELETED) {
+        wd->deleted_num--;
+    } else if (wd->clear_nodes != NULL) {
+        wd->clear_nodes[wd->clear_node_num++] = i;
     }
 
-    hash_key = wd->hash_func(wd, pnode);
-    work = wd->first_level_node + hash_key;
-    if(work->sign1 == 0 && work->sign2 == 0)
-    {
-        work->sign1 = pnode->sign1;
-        work->sign2 = pnode->sign2;
-        work->uint1 = pnode->uint1;
-        work->next = ST_DICT_BAD_NODE;
+    st_dict_set_ctrl(wd, i, st_dict_h2(pnode));
+    work = st_dict_at(wd, wd->first_level_node, i);
+    work->sign1 = pnode->sign1;
+    work->sign2 = pnode->sign2;
+    st_dict_copy_data(wd, work, pnode);
+    work->next = ST_DICT_BAD_NODE;
 
-        if(wd->clear_nodes != NULL)
-        {
-            wd->clear_nodes[wd->clear_node_num++] = hash_key;
-        }
+    return work;
+}
+
+static int st_dict_open_alloc_table(st_dict_t *wd, st_dict_id_t hash_num,
+        bool need_clear)
+{
+    wd->first_level_node = st_dict_alloc_nodes(wd, hash_num);
+    if (wd->first_level_node == NULL) {
+        ST_ERROR("Failed to alloc mem for first_level_node.");
+        return -1;
     }
-    else
-    {
-        ret = st_dict_add_in(wd, pnode);
-        if(ret == ST_DICT_BAD_NODE)
-        {
-            ST_ERROR("Failed to add in node");
+    memset(wd->first_level_node, 0, wd->node_size * (size_t)hash_num);
+
+    wd->ctrl = (unsigned char *)st_malloc(hash_num + ST_DICT_GROUP_WIDTH);
+    if (wd->ctrl == NULL) {
+        ST_ERROR("Failed to alloc mem for ctrl.");
+        return -1;
+    }
+    memset(wd->ctrl, ST_DICT_CTRL_EMPTY, hash_num + ST_DICT_GROUP_WIDTH);
+
+    wd->clear_nodes = NULL;
+    if (need_clear) {
+        wd->clear_nodes = (st_dict_id_t *)st_malloc(
+                sizeof(st_dict_id_t) * (size_t)hash_num);
+        if (wd->clear_nodes == NULL) {
+            ST_ERROR("Failed to alloc mem for clear_nodes.");
             return -1;
         }
-        wd->node_pool[ret].next = work->next;
-        work->next = ret;
     }
-    wd->node_num++;
+    wd->clear_node_num = 0;
+    wd->deleted_num = 0;
+
+    wd->hash_num = hash_num;
+    wd->addr_mask = hash_num - 1;
 
     return 0;
 }
 
-int st_dict_add_no_seek(st_dict_t *wd, st_dict_node_t *pnode)
+static int st_dict_open_resize(st_dict_t *wd, st_dict_id_t hash_num)
 {
-    st_dict_id_t hash_key;
-    st_dict_id_t ret;
-    st_dict_node_t *work;
-
-    ST_CHECK_PARAM(pnode == NULL
-            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+    st_dict_t old;
+    st_dict_id_t i;
+
+    old = *wd;
+    wd->first_level_node = NULL;
+    wd->ctrl = NULL;
+    wd->clear_nodes = NULL;
+    if (st_dict_open_alloc_table(wd, hash_num,
+                old.clear_nodes != NULL) < 0) {
+        ST_ERROR("Failed to st_dict_open_alloc_table.");
+        goto ERR;
+    }
 
-    hash_key = wd->hash_func(wd, pnode);
-    work = wd->first_level_node + hash_key;
-    if(work->sign1 == 0 && work->sign2 == 0)
-    {
-        work->sign1 = pnode->sign1;
-        work->sign2 = pnode->sign2;
-        work->uint1 = pnode->uint1;
-        work->next = ST_DICT_BAD_NODE;
-        if(wd->clear_nodes != NULL)
-        {
-            wd->clear_nodes[wd->clear_node_num++] = hash_key;
+    for (i = 0; i < old.hash_num; i++) {
+        if (!st_dict_ctrl_is_full(old.ctrl[i])) {
+            continue;
         }
-    }
-    else
-    {
-        ret = st_dict_add_in(wd, pnode);
-        if(ret == ST_DICT_BAD_NODE)
-        {
-            ST_ERROR("Failed to add in node");
-            return -1;
+        if (st_dict_open_put(wd,
+                    st_dict_at(wd, old.first_level_node, i)) == NULL) {
+            ST_ERROR("Failed to st_dict_open_put.");
+            goto ERR;
         }
-        wd->node_pool[ret].next = work->next;
-        work->next = ret;
     }
-    wd->node_num++;
+
+    safe_st_aligned_free(old.first_level_node);
+    safe_st_free(old.ctrl);
+    safe_st_free(old.clear_nodes);
 
     return 0;
+
+ERR:
+    safe_st_aligned_free(wd->first_level_node);
+    safe_st_free(wd->ctrl);
+    safe_st_free(wd->clear_nodes);
+    *wd = old;
+    return -1;
 }
 
-int st_dict_seek(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg)
+// make sure there is room for one more node
+static int st_dict_open_reserve(st_dict_t *wd)
 {
-    st_dict_id_t hash_key;
-    st_dict_node_t *work;
+    if (wd->node_num + wd->deleted_num + 1
+            <= wd->hash_num - wd->hash_num / 8) {
+        return 0;
+    }
 
-    ST_CHECK_PARAM(pnode == NULL
-            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+    // mostly tombstones, rebuilding at the same size is enough
+    if (wd->deleted_num >= wd->hash_num / 4) {
+        return st_dict_open_resize(wd, wd->hash_num);
+    }
 
-    hash_key = wd->hash_func(wd, pnode);
-    work = wd->first_level_node + hash_key;
-    if(work->sign1 == 0 && work->sign2 == 0)
-    {
+    if (wd->hash_num > st_dict_max_num(wd->node_size) / 2) {
+        ST_ERROR("Too many nodes in dict["ST_DICT_ID_FMT"].", wd->node_num);
         return -1;
     }
 
-    if(wd->node_eq_func(work, pnode, node_eq_arg))
-    {
-        pnode->uint1 = work->uint1;
-        return 0;
+    return st_dict_open_resize(wd, wd->hash_num * 2);
+}
+
+static int st_dict_open_add(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    if (wd->read_only) {
+        ST_ERROR("Can not add node into a read-only dict.");
+        return -1;
     }
 
-    while(work->next != ST_DICT_BAD_NODE)
+    if (st_dict_open_reserve(wd) < 0) {
+        ST_ERROR("Failed to st_dict_open_reserve.");
+        return -1;
+    }
+
+    if (st_dict_open_put(wd, pnode) == NULL) {
+        ST_ERROR("Failed to st_dict_open_put.");
+        return -1;
+    }
+    wd->node_num++;
+
+    return 0;
+}
+
+static int st_dict_open_delete(st_dict_t *wd, st_dict_node_t *pnode,
+        void *node_eq_arg)
+{
+    st_dict_node_t *work;
+
+    work = st_dict_open_find(wd, pnode, node_eq_arg);
+    if (work == NULL) {
+        return -1;
+    }
+    st_dict_copy_data(wd, pnode, work);
+
+    // probing goes through tombstones, so the slot can not become empty
+    st_dict_set_ctrl(wd, st_dict_id_of(wd, wd->first_level_node, work),
+            ST_DICT_CTRL_DELETED);
+    work->sign1 = 0;
+    work->sign2 = 0;
+    work->uint1 = 0;
+    wd->deleted_num++;
+    wd->node_num--;
+
+    return 0;
+}
+
+static int st_dict_open_traverse(st_dict_t *wd, st_dict_id_t from,
+        st_dict_id_t to, st_dict_trav_func_t trav, void *args)
+{
+    st_dict_id_t id;
+
+    for (id = from; id < to; id++) {
+        if (!st_dict_ctrl_is_full(wd->ctrl[id])) {
+            continue;
+        }
+
+        if (trav != NULL
+                && trav(st_dict_at(wd, wd->first_level_node, id), args) < 0) {
+            ST_ERROR("Failed to trav.");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int st_dict_open_clear(st_dict_t *wd, st_dict_trav_func_t trav,
+        void *args)
+{
+    st_dict_node_t *work;
+    st_dict_id_t id;
+    st_dict_id_t i;
+
+    // every slot not empty is in clear_nodes, see st_dict_open_put
+    for (id = 0; id < wd->clear_node_num; id++) {
+        i = wd->clear_nodes[id];
+        if (wd->ctrl[i] == ST_DICT_CTRL_DELETED) {
+            st_dict_set_ctrl(wd, i, ST_DICT_CTRL_EMPTY);
+            wd->deleted_num--;
+            continue;
+        }
+        if (!st_dict_ctrl_is_full(wd->ctrl[i])) {
+            continue;
+        }
+
+        work = st_dict_at(wd, wd->first_level_node, i);
+        if (trav != NULL && trav(work, args) < 0) {
+            ST_ERROR("Failed to trav.");
+            return -1;
+        }
+        wd->node_num--;
+
+        work->sign1 = 0;
+        work->sign2 = 0;
+        work->uint1 = 0;
+        st_dict_set_ctrl(wd, i, ST_DICT_CTRL_EMPTY);
+    }
+
+    wd->clear_node_num = 0;
+
+    return 0;
+}
+
+static st_dict_t* st_dict_alloc()
+{
+    st_dict_t *wd;
+
+    wd = (st_dict_t *)st_malloc(sizeof(st_dict_t));
+    if(wd == NULL)
+    {
+        ST_ERROR("Failed to alloc mem for st_dict.");
+        return NULL;
+    }
+    memset(wd, 0, sizeof(st_dict_t));
+    wd->free_head = ST_DICT_BAD_NODE;
+    wd->node_size = sizeof(st_dict_node_t);
+
+    return wd;
+}
+
+st_dict_t* st_dict_create(st_dict_id_t hash_num,
+    st_dict_id_t realloc_node_num, st_dict_hash_fun_t hash_func,
+    st_dict_node_eq_fun_t node_eq_func, bool need_clear)
+{
+    return st_dict_create_ex(hash_num, realloc_node_num, hash_func,
+            node_eq_func, need_clear, NULL);
+}
+
+static st_dict_t* st_dict_create_open(st_dict_id_t hash_num,
+    st_dict_hash_fun_t hash_func, st_dict_node_eq_fun_t node_eq_func,
+    bool need_clear, size_t value_size)
+{
+    st_dict_t *wd;
+
+    ST_CHECK_PARAM(hash_num > st_dict_max_num(
+                st_dict_node_size(value_size)) / 2, NULL);
+
+    if ((wd = st_dict_alloc()) == NULL) {
+        ST_ERROR("Failed to st_dict_alloc.");
+        return NULL;
+    }
+
+    wd->engine = ST_DICT_ENGINE_OPEN;
+    wd->value_size = value_size;
+    wd->node_size = st_dict_node_size(value_size);
+    wd->hash_func = (hash_func != NULL) ? hash_func : st_dict_hash_fmix64;
+    wd->node_eq_func = (node_eq_func != NULL) ? node_eq_func
+                                              : st_dict_node_equal;
+
+    if (hash_num < ST_DICT_GROUP_WIDTH) {
+        hash_num = ST_DICT_GROUP_WIDTH;
+    }
+    hash_num = st_dict_bit_mask(hash_num - 1, true) + 1;
+
+    if (st_dict_open_alloc_table(wd, hash_num, need_clear) < 0) {
+        ST_ERROR("Failed to st_dict_open_alloc_table.");
+        goto FAILED;
+    }
+
+    return wd;
+
+FAILED:
+    safe_st_dict_destroy(wd);
+    return NULL;
+}
+
+st_dict_t* st_dict_create_ex(st_dict_id_t hash_num,
+    st_dict_id_t realloc_node_num, st_dict_hash_fun_t hash_func,
+    st_dict_node_eq_fun_t node_eq_func, bool need_clear,
+    const st_dict_opt_t *opt)
+{
+    st_dict_t      *wd;
+    size_t         value_size;
+
+    value_size = (opt != NULL) ? opt->value_size : 0;
+    ST_CHECK_PARAM(hash_num > st_dict_max_num(st_dict_node_size(value_size))
+            || realloc_node_num
+                > st_dict_max_num(st_dict_node_size(value_size))
+            || (need_clear && opt != NULL && opt->max_load_factor > 0)
+            || (opt != NULL && opt->concurrent && (need_clear
+                    || opt->engine != ST_DICT_ENGINE_CHAIN
+                    || opt->max_load_factor > 0)), NULL);
+
+    if (opt != NULL && opt->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_create_open(hash_num, hash_func, node_eq_func,
+                need_clear, opt->value_size);
+    }
+
+    wd = (st_dict_t *)st_malloc(sizeof(st_dict_t));
+    if(wd == NULL)
+    {
+        ST_ERROR("Failed to alloc mem for st_dict.");
+        return NULL;
+    }
+    bzero(wd, sizeof(st_dict_t));
+    wd->realloc_node_num = realloc_node_num;
+    wd->free_head = ST_DICT_BAD_NODE;
+    wd->value_size = value_size;
+    wd->node_size = st_dict_node_size(value_size);
+    if (opt != NULL) {
+        wd->max_load_factor = opt->max_load_factor;
+        wd->concurrent = opt->concurrent;
+    }
+    if(hash_func)
+    {
+        wd->hash_func = hash_func;
+    }
+    else
+    {
+        wd->hash_func = st_dict_hash_simple;
+    }
+    if(node_eq_func)
+    {
+        wd->node_eq_func = node_eq_func;
+    }
+    else
+    {
+        wd->node_eq_func = st_dict_node_equal;
+    }
+
+    wd->addr_mask = st_dict_bit_mask(hash_num, false);
+    wd->hash_num = wd->addr_mask + 1;
+    //ST_DEBUG("num=%d(0x%x), mask=0x%x, num=%d(0x%x)", hash_num, hash_num,
+        //wd->addr_mask, wd->hash_num, wd->hash_num);
+    wd->first_level_node = st_dict_alloc_nodes(wd, wd->hash_num);
+    if(wd->first_level_node == NULL)
+    {
+        ST_ERROR("Failed to alloc mem for first_level_node.");
+        goto FAILED;
+    }
+
+    wd->node_pool = st_dict_alloc_nodes(wd, wd->hash_num);
+    if(wd->node_pool == NULL)
+    {
+        ST_ERROR("Failed to alloc mem for node_pool.");
+        goto FAILED;
+    }
+
+    if(need_clear)
+    {
+        wd->clear_nodes = (st_dict_id_t *)
+            st_malloc(sizeof(st_dict_id_t)*wd->hash_num);
+        if(wd->clear_nodes == NULL)
+        {
+            ST_ERROR("Failed to alloc mem for clear_nodes.");
+            goto FAILED;
+        }
+        wd->clear_node_num = 0;
+    }
+
+    st_dict_reset_nodes(wd, wd->first_level_node, 0, wd->hash_num);
+    st_dict_reset_nodes(wd, wd->node_pool, 0, wd->hash_num);
+    wd->node_num = 0;
+    wd->max_pool_num = wd->hash_num;
+    wd->cur_index = 0;
+
+    return wd;
+
+FAILED:
+    safe_st_dict_destroy(wd);
+    return NULL;
+}
+
+/*
+ * Concurrent readers.
+ *
+ * A chained dict is read without any lock: the writer fills a node
+ * completely before publishing it, either by storing the signs of a
+ * first_level_node (both signs in one 64-bit store) or by storing the id of
+ * a pooled node into the next field of its predecessor, with release
+ * semantics. Readers use acquire loads for the same fields and for
+ * node_pool. In concurrent mode, node_pool is never realloced in place:
+ * a larger copy is published and the old one is retired, until
+ * st_dict_reclaim or st_dict_destroy.
+ */
+typedef uint64_t __attribute__((__may_alias__)) st_dict_signs_t;
+
+static inline bool st_dict_load_empty(st_dict_node_t *node)
+{
+    return __atomic_load_n((st_dict_signs_t *)&node->sign1,
+            __ATOMIC_ACQUIRE) == 0;
+}
+
+static inline void st_dict_store_signs(st_dict_node_t *node,
+        st_dict_node_t *pnode)
+{
+    st_dict_signs_t signs;
+
+    memcpy(&signs, &pnode->sign1, sizeof(signs));
+    __atomic_store_n((st_dict_signs_t *)&node->sign1, signs,
+            __ATOMIC_RELEASE);
+}
+
+// replace node_pool by a copy of num nodes
+static int st_dict_publish_pool(st_dict_t *wd, st_dict_id_t num)
+{
+    st_dict_node_t *pool;
+    st_dict_node_t **retired;
+
+    retired = (st_dict_node_t **)st_realloc(wd->retired_pools,
+            sizeof(st_dict_node_t *) * (wd->retired_num + 1));
+    if (retired == NULL) {
+        ST_ERROR("Failed to st_realloc retired_pools.");
+        return -1;
+    }
+    wd->retired_pools = retired;
+
+    pool = st_dict_alloc_nodes(wd, num);
+    if (pool == NULL) {
+        ST_ERROR("Failed to alloc node_pool.");
+        return -1;
+    }
+    memcpy(pool, wd->node_pool, wd->node_size * wd->max_pool_num);
+    bzero(st_dict_at(wd, pool, wd->max_pool_num),
+            wd->node_size * (num - wd->max_pool_num));
+
+    wd->retired_pools[wd->retired_num++] = wd->node_pool;
+    __atomic_store_n(&wd->node_pool, pool, __ATOMIC_RELEASE);
+    wd->max_pool_num = num;
+
+    return 0;
+}
+
+int st_dict_reclaim(st_dict_t *wd)
+{
+    int i;
+
+    ST_CHECK_PARAM(wd == NULL, -1);
+
+    for (i = 0; i < wd->retired_num; i++) {
+        safe_st_aligned_free(wd->retired_pools[i]);
+    }
+    safe_st_free(wd->retired_pools);
+    wd->retired_num = 0;
+
+    return 0;
+}
+
+// enlarge node_pool to num nodes
+static int st_dict_resize_pool(st_dict_t *wd, st_dict_id_t num)
+{
+    if (wd->concurrent) {
+        return st_dict_publish_pool(wd, num);
+    }
+
+    wd->node_pool = (st_dict_node_t *)st_aligned_realloc(wd->node_pool,
+        num*wd->node_size, ST_DICT_ALIGN);
+    if(wd->node_pool == NULL)
+    {
+        ST_ERROR("Realloc node_pool failed.");
+        return -1;
+    }
+    bzero(st_dict_at(wd, wd->node_pool, wd->max_pool_num),
+            (num - wd->max_pool_num)*wd->node_size);
+
+    wd->max_pool_num = num;
+
+    return 0;
+}
+
+static int st_dict_grow_pool(st_dict_t *wd)
+{
+    st_dict_id_t num;
+
+    if(wd->cur_index < wd->max_pool_num)
+    {
+        return 0;
+    }
+
+    // every growth copies the whole pool in concurrent mode
+    if (wd->concurrent) {
+        num = max(wd->realloc_node_num, wd->max_pool_num);
+    } else {
+        num = wd->realloc_node_num;
+    }
+    if (num > st_dict_max_num(wd->node_size) - wd->max_pool_num) {
+        ST_ERROR("Too many nodes in node_pool["ST_DICT_ID_FMT"].",
+                wd->max_pool_num);
+        return -1;
+    }
+
+    return st_dict_resize_pool(wd, wd->max_pool_num + num);
+}
+
+// make room for num nodes from cur_index on
+static int st_dict_reserve_pool(st_dict_t *wd, st_dict_id_t num)
+{
+    if (num > st_dict_max_num(wd->node_size) - wd->cur_index) {
+        ST_ERROR("Too many nodes in node_pool["ST_DICT_ID_FMT"].",
+                wd->cur_index);
+        return -1;
+    }
+
+    if (wd->cur_index + num <= wd->max_pool_num) {
+        return 0;
+    }
+
+    return st_dict_resize_pool(wd, wd->cur_index + num);
+}
+
+// give node_pool[did] back to the free list
+static void st_dict_free_node(st_dict_t *wd, st_dict_id_t did)
+{
+    st_dict_node_t *node;
+
+    node = st_dict_at(wd, wd->node_pool, did);
+    node->sign1 = 0;
+    node->sign2 = 0;
+    node->uint1 = 0;
+    node->next = wd->free_head;
+    wd->free_head = did;
+}
+
+static st_dict_id_t st_dict_add_in(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    st_dict_node_t *node;
+    st_dict_id_t did;
+
+    if (wd->free_head != ST_DICT_BAD_NODE) {
+        did = wd->free_head;
+        node = st_dict_at(wd, wd->node_pool, did);
+        wd->free_head = node->next;
+
+        node->sign1 = pnode->sign1;
+        node->sign2 = pnode->sign2;
+        st_dict_copy_data(wd, node, pnode);
+        node->next = ST_DICT_BAD_NODE;
+
+        return did;
+    }
+
+    if(st_dict_grow_pool(wd) < 0)
+    {
+        return ST_DICT_BAD_NODE;
+    }
+    node = st_dict_at(wd, wd->node_pool, wd->cur_index);
+    node->sign1 = pnode->sign1;
+    node->sign2 = pnode->sign2;
+    st_dict_copy_data(wd, node, pnode);
+    node->next = ST_DICT_BAD_NODE;
+
+    __atomic_store_n(&wd->cur_index, wd->cur_index + 1, __ATOMIC_RELAXED);
+
+    return wd->cur_index - 1;
+}
+
+/*
+ * Incremental rehash.
+ *
+ * When node_num exceeds max_load_factor * hash_num, first_level_node is
+ * doubled and the previous table is kept in old_first_level_node. Every
+ * insertion then migrates a few buckets of the old table, in order, so the
+ * buckets below rehash_idx are in the new table and the others are still in
+ * the old one. Since hash_func masks its value with addr_mask, the old
+ * bucket of a node is its new bucket masked with old_addr_mask.
+ */
+#define ST_DICT_REHASH_STEP 4
+
+// bucket of pnode, in the old table if it is not migrated yet
+static inline st_dict_node_t* st_dict_bucket(st_dict_t *wd,
+        st_dict_node_t *pnode, st_dict_id_t *hash_key)
+{
+    st_dict_id_t h;
+
+    h = wd->hash_func(wd, pnode);
+    if (wd->old_first_level_node != NULL
+            && (h & wd->old_addr_mask) >= wd->rehash_idx) {
+        *hash_key = h & wd->old_addr_mask;
+        return st_dict_at(wd, wd->old_first_level_node, *hash_key);
+    }
+
+    *hash_key = h;
+    return st_dict_at(wd, wd->first_level_node, h);
+}
+
+static int st_dict_rehash_start(st_dict_t *wd)
+{
+    st_dict_node_t *table;
+    st_dict_id_t hash_num;
+
+    if (wd->hash_num > st_dict_max_num(wd->node_size) / 2) {
+        return 0;
+    }
+    hash_num = wd->hash_num * 2;
+
+    table = st_dict_alloc_nodes(wd, hash_num);
+    if (table == NULL) {
+        ST_ERROR("Failed to alloc mem for first_level_node.");
+        return -1;
+    }
+    st_dict_reset_nodes(wd, table, 0, hash_num);
+
+    wd->old_first_level_node = wd->first_level_node;
+    wd->old_hash_num = wd->hash_num;
+    wd->old_addr_mask = wd->addr_mask;
+    wd->rehash_idx = 0;
+
+    wd->first_level_node = table;
+    wd->hash_num = hash_num;
+    wd->addr_mask = hash_num - 1;
+
+    return 0;
+}
+
+// move node_pool[did] into the new table
+static void st_dict_rehash_move(st_dict_t *wd, st_dict_id_t did)
+{
+    st_dict_node_t *node;
+    st_dict_node_t *work;
+
+    node = st_dict_at(wd, wd->node_pool, did);
+    work = st_dict_at(wd, wd->first_level_node, wd->hash_func(wd, node));
+    if (work->sign1 == 0 && work->sign2 == 0) {
+        work->sign1 = node->sign1;
+        work->sign2 = node->sign2;
+        st_dict_copy_data(wd, work, node);
+        work->next = ST_DICT_BAD_NODE;
+
+        st_dict_free_node(wd, did);
+    } else {
+        node->next = work->next;
+        work->next = did;
+    }
+}
+
+static int st_dict_rehash_bucket(st_dict_t *wd, st_dict_id_t b)
+{
+    st_dict_node_t *old;
+    st_dict_node_t *work;
+    st_dict_id_t did;
+    st_dict_id_t next;
+    st_dict_id_t ret;
+
+    old = st_dict_at(wd, wd->old_first_level_node, b);
+
+    // reserve a node before moving anything, so that we never fail halfway
+    if (st_dict_grow_pool(wd) < 0) {
+        ST_ERROR("Failed to st_dict_grow_pool.");
+        return -1;
+    }
+
+    did = old->next;
+    while (did != ST_DICT_BAD_NODE) {
+        next = st_dict_at(wd, wd->node_pool, did)->next;
+        st_dict_rehash_move(wd, did);
+        did = next;
+    }
+
+    work = st_dict_at(wd, wd->first_level_node, wd->hash_func(wd, old));
+    if (work->sign1 == 0 && work->sign2 == 0) {
+        work->sign1 = old->sign1;
+        work->sign2 = old->sign2;
+        st_dict_copy_data(wd, work, old);
+        work->next = ST_DICT_BAD_NODE;
+    } else {
+        ret = st_dict_add_in(wd, old);
+        st_dict_at(wd, wd->node_pool, ret)->next = work->next;
+        work->next = ret;
+    }
+
+    old->sign1 = 0;
+    old->sign2 = 0;
+    old->uint1 = 0;
+    old->next = ST_DICT_BAD_NODE;
+
+    return 0;
+}
+
+static int st_dict_rehash_step(st_dict_t *wd, int n)
+{
+    st_dict_node_t *old;
+    int empty_visits;
+
+    empty_visits = n * 10;
+    while (n > 0 && wd->rehash_idx < wd->old_hash_num) {
+        old = st_dict_at(wd, wd->old_first_level_node, wd->rehash_idx);
+        if (old->sign1 == 0 && old->sign2 == 0) {
+            wd->rehash_idx++;
+            if (--empty_visits <= 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (st_dict_rehash_bucket(wd, wd->rehash_idx) < 0) {
+            ST_ERROR("Failed to st_dict_rehash_bucket.");
+            return -1;
+        }
+        wd->rehash_idx++;
+        n--;
+    }
+
+    if (wd->rehash_idx >= wd->old_hash_num) {
+        safe_st_aligned_free(wd->old_first_level_node);
+        wd->old_hash_num = 0;
+        wd->old_addr_mask = 0;
+        wd->rehash_idx = 0;
+    }
+
+    return 0;
+}
+
+static int st_dict_rehash_finish(st_dict_t *wd)
+{
+    while (wd->old_first_level_node != NULL) {
+        if (st_dict_rehash_step(wd, ST_DICT_REHASH_STEP) < 0) {
+            ST_ERROR("Failed to st_dict_rehash_step.");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// called before every insertion
+static int st_dict_rehash_check(st_dict_t *wd)
+{
+    if (wd->old_first_level_node == NULL) {
+        if (wd->max_load_factor <= 0
+                || wd->node_num < wd->max_load_factor * wd->hash_num) {
+            return 0;
+        }
+
+        if (st_dict_rehash_start(wd) < 0) {
+            ST_ERROR("Failed to st_dict_rehash_start.");
+            return -1;
+        }
+
+        if (wd->old_first_level_node == NULL) {
+            return 0;
+        }
+    }
+
+    return st_dict_rehash_step(wd, ST_DICT_REHASH_STEP);
+}
+
+static int st_dict_chain_add(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    st_dict_id_t hash_key;
+    st_dict_id_t ret;
+    st_dict_node_t *work;
+
+    if (wd->read_only) {
+        ST_ERROR("Can not add node into a read-only dict.");
+        return -1;
+    }
+
+    if (st_dict_rehash_check(wd) < 0) {
+        ST_ERROR("Failed to st_dict_rehash_check.");
+        return -1;
+    }
+
+    work = st_dict_bucket(wd, pnode, &hash_key);
+    if(work->sign1 == 0 && work->sign2 == 0)
+    {
+        st_dict_copy_data(wd, work, pnode);
+        work->next = ST_DICT_BAD_NODE;
+        st_dict_store_signs(work, pnode);
+
+        if(wd->clear_nodes != NULL)
+        {
+            wd->clear_nodes[wd->clear_node_num++] = hash_key;
+        }
+    }
+    else
+    {
+        ret = st_dict_add_in(wd, pnode);
+        if(ret == ST_DICT_BAD_NODE)
+        {
+            ST_ERROR("Failed to add in node");
+            return -1;
+        }
+        st_dict_at(wd, wd->node_pool, ret)->next = work->next;
+        __atomic_store_n(&work->next, ret, __ATOMIC_RELEASE);
+    }
+    wd->node_num++;
+
+    return 0;
+}
+
+int st_dict_add(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg)
+{
+    ST_CHECK_PARAM(pnode == NULL
+            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+
+    if(st_dict_seek(wd, pnode, node_eq_arg)== 0)
+    {
+        ST_ERROR("node already exists");
+        return -1;
+    }
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_add(wd, pnode);
+    }
+
+    return st_dict_chain_add(wd, pnode);
+}
+
+int st_dict_add_no_seek(st_dict_t *wd, st_dict_node_t *pnode)
+{
+    ST_CHECK_PARAM(pnode == NULL
+            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_add(wd, pnode);
+    }
+
+    return st_dict_chain_add(wd, pnode);
+}
+
+// forget bucket hash_key in clear_nodes
+static void st_dict_unlist_bucket(st_dict_t *wd, st_dict_id_t hash_key)
+{
+    st_dict_id_t i;
+
+    for (i = 0; i < wd->clear_node_num; i++) {
+        if (wd->clear_nodes[i] == hash_key) {
+            wd->clear_nodes[i] = wd->clear_nodes[--wd->clear_node_num];
+            return;
+        }
+    }
+}
+
+static int st_dict_chain_delete(st_dict_t *wd, st_dict_node_t *pnode,
+        void *node_eq_arg)
+{
+    st_dict_id_t hash_key;
+    st_dict_id_t did;
+    st_dict_node_t *work;
+    st_dict_node_t *node;
+
+    work = st_dict_bucket(wd, pnode, &hash_key);
+    if (work->sign1 == 0 && work->sign2 == 0) {
+        return -1;
+    }
+
+    if (wd->node_eq_func(work, pnode, node_eq_arg)) {
+        st_dict_copy_data(wd, pnode, work);
+        did = work->next;
+        if (did == ST_DICT_BAD_NODE) {
+            work->sign1 = 0;
+            work->sign2 = 0;
+            work->uint1 = 0;
+            if (wd->clear_nodes != NULL) {
+                st_dict_unlist_bucket(wd, hash_key);
+            }
+        } else {
+            // promote the first chained node into the bucket
+            node = st_dict_at(wd, wd->node_pool, did);
+            work->sign1 = node->sign1;
+            work->sign2 = node->sign2;
+            st_dict_copy_data(wd, work, node);
+            work->next = node->next;
+            st_dict_free_node(wd, did);
+        }
+        wd->node_num--;
+        return 0;
+    }
+
+    while ((did = work->next) != ST_DICT_BAD_NODE) {
+        if (did >= wd->cur_index) {
+            ST_ERROR("illegal next["ST_DICT_ID_FMT"/"ST_DICT_ID_FMT"]",
+                    did, wd->cur_index);
+            return -1;
+        }
+        node = st_dict_at(wd, wd->node_pool, did);
+        if (wd->node_eq_func(node, pnode, node_eq_arg)) {
+            st_dict_copy_data(wd, pnode, node);
+            work->next = node->next;
+            st_dict_free_node(wd, did);
+            wd->node_num--;
+            return 0;
+        }
+        work = node;
+    }
+
+    return -1;
+}
+
+int st_dict_delete(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg)
+{
+    ST_CHECK_PARAM(wd == NULL || pnode == NULL
+            || (pnode->sign1 == 0 && pnode->sign2 == 0)
+            || wd->read_only || wd->concurrent, -1);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_delete(wd, pnode, node_eq_arg);
+    }
+
+    return st_dict_chain_delete(wd, pnode, node_eq_arg);
+}
+
+// next node in the chain of work, NULL at the end of the chain
+static inline st_dict_node_t* st_dict_chain_next(st_dict_t *wd,
+        st_dict_node_t *work)
+{
+    st_dict_id_t next;
+
+    next = __atomic_load_n(&work->next, __ATOMIC_ACQUIRE);
+    if (next == ST_DICT_BAD_NODE) {
+        return NULL;
+    }
+    if (next >= __atomic_load_n(&wd->cur_index, __ATOMIC_RELAXED)) {
+        ST_ERROR("illegal next["ST_DICT_ID_FMT"/"ST_DICT_ID_FMT"]",
+                next, wd->cur_index);
+        return NULL;
+    }
+
+    return st_dict_at(wd, __atomic_load_n(&wd->node_pool, __ATOMIC_ACQUIRE),
+            next);
+}
+
+st_dict_node_t* st_dict_find(st_dict_t *wd, st_dict_node_t *pnode,
+        void *node_eq_arg)
+{
+    st_dict_id_t hash_key;
+    st_dict_node_t *work;
+
+    ST_CHECK_PARAM(wd == NULL || pnode == NULL
+            || (pnode->sign1 == 0 && pnode->sign2 == 0), NULL);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_find(wd, pnode, node_eq_arg);
+    }
+
+    work = st_dict_bucket(wd, pnode, &hash_key);
+    if(st_dict_load_empty(work))
+    {
+        return NULL;
+    }
+
+    while (work != NULL) {
+        if(wd->node_eq_func(work, pnode, node_eq_arg))
+        {
+            return work;
+        }
+        work = st_dict_chain_next(wd, work);
+    }
+
+    return NULL;
+}
+
+int st_dict_seek(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg)
+{
+    st_dict_node_t *work;
+
+    ST_CHECK_PARAM(pnode == NULL
+            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+
+    work = st_dict_find(wd, pnode, node_eq_arg);
+    if (work == NULL) {
+        return -1;
+    }
+    st_dict_copy_data(wd, pnode, work);
+
+    return 0;
+}
+
+/*
+ * Keys are processed in groups of ST_DICT_SEEK_BATCH. All the buckets of a
+ * group are prefetched before any of them is touched, then the chains are
+ * walked round-robin, one node per key per round, prefetching the next node
+ * of every chain, so that the misses of the group overlap.
+ */
+#define ST_DICT_SEEK_BATCH 16
+
+int st_dict_seek_batch(st_dict_t *wd, st_dict_node_t *nodes, int n,
+        void **node_eq_args, int *rets)
+{
+    st_dict_node_t *work[ST_DICT_SEEK_BATCH];
+    st_dict_node_t *pnode;
+    st_dict_id_t hash_key;
+    void *arg;
+    int num_found;
+    int active;
+    int b, i, k;
+
+    ST_CHECK_PARAM(wd == NULL || nodes == NULL || n < 0 || rets == NULL, -1);
+
+    num_found = 0;
+    for (b = 0; b < n; b += ST_DICT_SEEK_BATCH) {
+        k = n - b < ST_DICT_SEEK_BATCH ? n - b : ST_DICT_SEEK_BATCH;
+
+        for (i = 0; i < k; i++) {
+            pnode = st_dict_at(wd, nodes, b + i);
+            rets[b + i] = -1;
+            if (pnode->sign1 == 0 && pnode->sign2 == 0) {
+                work[i] = NULL;
+                continue;
+            }
+
+            if (wd->engine == ST_DICT_ENGINE_OPEN) {
+                hash_key = wd->hash_func(wd, pnode);
+                __builtin_prefetch(wd->ctrl + hash_key);
+                work[i] = st_dict_at(wd, wd->first_level_node, hash_key);
+            } else {
+                work[i] = st_dict_bucket(wd, pnode, &hash_key);
+            }
+            __builtin_prefetch(work[i]);
+        }
+
+        if (wd->engine == ST_DICT_ENGINE_OPEN) {
+            for (i = 0; i < k; i++) {
+                if (work[i] == NULL) {
+                    continue;
+                }
+                pnode = st_dict_at(wd, nodes, b + i);
+                arg = (node_eq_args != NULL) ? node_eq_args[b + i] : NULL;
+                work[i] = st_dict_open_find(wd, pnode, arg);
+                if (work[i] != NULL) {
+                    st_dict_copy_data(wd, pnode, work[i]);
+                    rets[b + i] = 0;
+                    num_found++;
+                }
+            }
+            continue;
+        }
+
+        for (i = 0; i < k; i++) {
+            if (work[i] != NULL && st_dict_load_empty(work[i])) {
+                work[i] = NULL;
+            }
+        }
+
+        do {
+            active = 0;
+            for (i = 0; i < k; i++) {
+                if (work[i] == NULL) {
+                    continue;
+                }
+                pnode = st_dict_at(wd, nodes, b + i);
+                arg = (node_eq_args != NULL) ? node_eq_args[b + i] : NULL;
+                if (wd->node_eq_func(work[i], pnode, arg)) {
+                    st_dict_copy_data(wd, pnode, work[i]);
+                    rets[b + i] = 0;
+                    num_found++;
+                    work[i] = NULL;
+                    continue;
+                }
+
+                work[i] = st_dict_chain_next(wd, work[i]);
+                if (work[i] != NULL) {
+                    __builtin_prefetch(work[i]);
+                    active++;
+                }
+            }
+        } while (active > 0);
+    }
+
+    return num_found;
+}
+
+/*
+ * Binary format.
+ *
+ * A st_dict_header_t, followed by first_level_node, then node_pool (only
+ * the cur_index used nodes) for chained dicts or ctrl for open dicts. Each
+ * array starts at a multiple of ST_DICT_ALIGN from the beginning of the
+ * header, so a mapped file can be used in place.
+ */
+#define ST_DICT_MAGIC   0x54434453 // "SDCT"
+#define ST_DICT_VERSION 1
+
+#define ST_DICT_HASH_CUSTOM 0xFFFF
+
+typedef struct _st_dict_header_t_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t id_size; /* sizeof(st_dict_id_t). */
+    uint32_t node_size; /* stride of node arrays. */
+    uint32_t engine;
+    uint32_t hash_id; /* index in st_dict_hash_funcs or ST_DICT_HASH_CUSTOM. */
+    float    max_load_factor;
+    uint32_t group_width;
+
+    uint64_t hash_num;
+    uint64_t realloc_node_num;
+    uint64_t cur_index;
+    uint64_t max_pool_num;
+    uint64_t node_num;
+    uint64_t free_head;
+    uint64_t deleted_num;
+    uint64_t value_size;
+
+    char     reserved[32];
+} st_dict_header_t;
+
+static st_dict_hash_fun_t st_dict_hash_funcs[] = {
+    st_dict_hash_simple,
+    st_dict_hash_sign1l16,
+    st_dict_hash_sign1,
+    st_dict_hash_fmix64,
+    st_dict_hash_xxh3,
+    st_dict_hash_wyhash,
+};
+
+static uint32_t st_dict_hash_id(st_dict_hash_fun_t hash_func)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(st_dict_hash_funcs) / sizeof(st_dict_hash_funcs[0]);
+            i++) {
+        if (st_dict_hash_funcs[i] == hash_func) {
+            return i;
+        }
+    }
+
+    return ST_DICT_HASH_CUSTOM;
+}
+
+static int st_dict_write_array(FILE *fp, const void *arr, size_t sz,
+        size_t n)
+{
+    static const char zeros[ST_DICT_ALIGN] = {0};
+    size_t pad;
+
+    if (fwrite(arr, sz, n, fp) != n) {
+        return -1;
+    }
+
+    pad = st_dict_align(sz * n) - sz * n;
+    if (pad > 0 && fwrite(zeros, 1, pad, fp) != pad) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int st_dict_read_array(FILE *fp, void *arr, size_t sz, size_t n)
+{
+    char pad[ST_DICT_ALIGN];
+    size_t num_pad;
+
+    if (fread(arr, sz, n, fp) != n) {
+        return -1;
+    }
+
+    num_pad = st_dict_align(sz * n) - sz * n;
+    if (num_pad > 0 && fread(pad, 1, num_pad, fp) != num_pad) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int st_dict_save(st_dict_t *wd, FILE *fp)
+{
+    st_dict_header_t header;
+
+    ST_CHECK_PARAM(wd == NULL || fp == NULL, -1);
+
+    if (st_dict_rehash_finish(wd) < 0) {
+        ST_ERROR("Failed to st_dict_rehash_finish.");
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ST_DICT_MAGIC;
+    header.version = ST_DICT_VERSION;
+    header.id_size = sizeof(st_dict_id_t);
+    header.node_size = (uint32_t)wd->node_size;
+    header.engine = wd->engine;
+    header.hash_id = st_dict_hash_id(wd->hash_func);
+    header.max_load_factor = wd->max_load_factor;
+    header.group_width = ST_DICT_GROUP_WIDTH;
+    header.hash_num = wd->hash_num;
+    header.realloc_node_num = wd->realloc_node_num;
+    header.cur_index = wd->cur_index;
+    header.max_pool_num = wd->max_pool_num;
+    header.node_num = wd->node_num;
+    header.free_head = wd->free_head;
+    header.deleted_num = wd->deleted_num;
+    header.value_size = wd->value_size;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to write header");
+        return -1;
+    }
+
+    if (st_dict_write_array(fp, wd->first_level_node,
+                wd->node_size, wd->hash_num) < 0) {
+        ST_ERROR("Failed to write first_level_node");
+        return -1;
+    }
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        if (st_dict_write_array(fp, wd->ctrl, 1,
+                    wd->hash_num + ST_DICT_GROUP_WIDTH) < 0) {
+            ST_ERROR("Failed to write ctrl");
+            return -1;
+        }
+    } else {
+        if (st_dict_write_array(fp, wd->node_pool,
+                    wd->node_size, wd->cur_index) < 0) {
+            ST_ERROR("Failed to write node_pool");
+            return -1;
+        }
+    }
+
+    fflush(fp);
+
+    return 0;
+}
+
+static int st_dict_parse_header(st_dict_t *wd, st_dict_header_t *header)
+{
+    if (header->magic != ST_DICT_MAGIC) {
+        ST_ERROR("Not a dict file.");
+        return -1;
+    }
+
+    if (header->version != ST_DICT_VERSION) {
+        ST_ERROR("Unknown dict version[%u].", header->version);
+        return -1;
+    }
+
+    if (header->id_size != sizeof(st_dict_id_t)
+            || header->value_size > UINT32_MAX
+            || header->node_size != st_dict_node_size(header->value_size)) {
+        ST_ERROR("Dict saved with different layout: id_size[%u/%zu], "
+                "node_size[%u/%zu].", header->id_size, sizeof(st_dict_id_t),
+                header->node_size,
+                st_dict_node_size((size_t)header->value_size));
+        return -1;
+    }
+    wd->value_size = (size_t)header->value_size;
+    wd->node_size = header->node_size;
+
+    if (header->engine != ST_DICT_ENGINE_CHAIN
+            && header->engine != ST_DICT_ENGINE_OPEN) {
+        ST_ERROR("Unknown engine[%u].", header->engine);
+        return -1;
+    }
+
+    if (header->engine == ST_DICT_ENGINE_OPEN
+            && header->group_width != ST_DICT_GROUP_WIDTH) {
+        ST_ERROR("Group width mismatch[%u/%d].", header->group_width,
+                ST_DICT_GROUP_WIDTH);
+        return -1;
+    }
+
+    if (header->hash_num == 0 || header->hash_num > st_dict_max_num(wd->node_size)
+            || (header->hash_num & (header->hash_num - 1)) != 0
+            || header->max_pool_num > st_dict_max_num(wd->node_size)
+            || header->realloc_node_num > st_dict_max_num(wd->node_size)
+            || header->cur_index > header->max_pool_num
+            || header->node_num > header->hash_num + header->cur_index
+            || (header->free_head != ST_DICT_BAD_NODE
+                && header->free_head >= header->cur_index)
+            || header->deleted_num > header->hash_num) {
+        ST_ERROR("Invalid dict header.");
+        return -1;
+    }
+
+    wd->engine = (st_dict_engine_t)header->engine;
+    wd->max_load_factor = header->max_load_factor;
+    wd->hash_num = (st_dict_id_t)header->hash_num;
+    wd->addr_mask = wd->hash_num - 1;
+    wd->realloc_node_num = (st_dict_id_t)header->realloc_node_num;
+    wd->cur_index = (st_dict_id_t)header->cur_index;
+    wd->max_pool_num = (st_dict_id_t)header->max_pool_num;
+    wd->node_num = (st_dict_id_t)header->node_num;
+    wd->free_head = (st_dict_id_t)header->free_head;
+    wd->deleted_num = (st_dict_id_t)header->deleted_num;
+
+    if (header->hash_id < sizeof(st_dict_hash_funcs)
+            / sizeof(st_dict_hash_funcs[0])) {
+        wd->hash_func = st_dict_hash_funcs[header->hash_id];
+    } else {
+        ST_WARNING("Dict saved with a custom hash_func, "
+                "which must be set by caller.");
+        wd->hash_func = st_dict_hash_simple;
+    }
+    wd->node_eq_func = st_dict_node_equal;
+
+    return 0;
+}
+
+// format without header, hash_num was already read
+static int st_dict_load_legacy(st_dict_t *wd, FILE *fp)
+{
+    size_t ret = 0;
+
+    ret = fread(&wd->realloc_node_num, sizeof(st_dict_id_t), 1, fp);
+    if(ret != 1)
     {
-        if(work->next >= wd->cur_index)
-        {
-            ST_ERROR("illegal next[%u/%u]", work->next, wd->cur_index);
+        ST_ERROR("Failed to read realloc_node_num");
+        return -1;
+    }
+
+    ret = fread(&wd->cur_index, sizeof(st_dict_id_t), 1, fp);
+    if(ret != 1)
+    {
+        ST_ERROR("Failed to read cur_index");
+        return -1;
+    }
+
+    ret = fread(&wd->max_pool_num, sizeof(st_dict_id_t), 1, fp);
+    if(ret != 1)
+    {
+        ST_ERROR("Failed to read max_pool_num");
+        return -1;
+    }
+
+    ret = fread(&wd->node_num, sizeof(st_dict_id_t), 1, fp);
+    if(ret != 1)
+    {
+        ST_ERROR("Failed to read node_num");
+        return -1;
+    }
+
+    ret = fread(&wd->addr_mask, sizeof(st_dict_id_t), 1, fp);
+    if(ret != 1)
+    {
+        ST_ERROR("Failed to read addr_mask");
+        return -1;
+    }
+
+    wd->first_level_node = st_dict_alloc_nodes(wd, wd->hash_num);
+    if(wd->first_level_node == NULL)
+    {
+        ST_ERROR("Failed to alloc first_level_node.");
+        return -1;
+    }
+
+    wd->node_pool = st_dict_alloc_nodes(wd, wd->max_pool_num);
+    if(wd->node_pool == NULL)
+    {
+        ST_ERROR("Failed to alloc node_pool.");
+        return -1;
+    }
+
+    ret = fread(wd->first_level_node, sizeof(st_dict_node_t),
+        wd->hash_num, fp);
+    if(ret != wd->hash_num)
+    {
+        ST_ERROR("Failed to read first_level_node");
+        return -1;
+    }
+
+    ret = fread(wd->node_pool, sizeof(st_dict_node_t),
+        wd->max_pool_num, fp);
+    if(ret != wd->max_pool_num)
+    {
+        ST_ERROR("Failed to read node_pool");
+        return -1;
+    }
+
+    return 0;
+}
+
+int st_dict_load(st_dict_t *wd, FILE *fp)
+{
+    st_dict_header_t header;
+
+    ST_CHECK_PARAM(wd == NULL || fp == NULL, -1);
+
+    if (fread(&header.magic, sizeof(header.magic), 1, fp) != 1) {
+        ST_ERROR("Failed to read magic");
+        return -1;
+    }
+
+    if (header.magic != ST_DICT_MAGIC) {
+        // files saved before the header was introduced
+#ifdef _ST_DICT_64BIT_ID_
+        ST_ERROR("Dict files without header have 32-bit ids, "
+                "load them with a 32-bit build and save them again.");
+        return -1;
+#endif
+        wd->hash_num = header.magic;
+        wd->free_head = ST_DICT_BAD_NODE;
+        wd->value_size = 0;
+        wd->node_size = sizeof(st_dict_node_t);
+        wd->hash_func = st_dict_hash_simple;
+        wd->node_eq_func = st_dict_node_equal;
+        return st_dict_load_legacy(wd, fp);
+    }
+
+    if (fread((char *)&header + sizeof(header.magic),
+                sizeof(header) - sizeof(header.magic), 1, fp) != 1) {
+        ST_ERROR("Failed to read header");
+        return -1;
+    }
+
+    if (st_dict_parse_header(wd, &header) < 0) {
+        ST_ERROR("Failed to st_dict_parse_header.");
+        return -1;
+    }
+
+    wd->first_level_node = st_dict_alloc_nodes(wd, wd->hash_num);
+    if (wd->first_level_node == NULL) {
+        ST_ERROR("Failed to alloc first_level_node.");
+        return -1;
+    }
+
+    if (st_dict_read_array(fp, wd->first_level_node,
+                wd->node_size, wd->hash_num) < 0) {
+        ST_ERROR("Failed to read first_level_node");
+        return -1;
+    }
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        wd->ctrl = (unsigned char *)st_malloc(wd->hash_num
+                + ST_DICT_GROUP_WIDTH);
+        if (wd->ctrl == NULL) {
+            ST_ERROR("Failed to alloc ctrl.");
             return -1;
         }
-        work = wd->node_pool + work->next;
-        if(wd->node_eq_func(work, pnode, node_eq_arg))
-        {
-            pnode->uint1 = work->uint1;
-            return 0;
+
+        if (st_dict_read_array(fp, wd->ctrl, 1,
+                    wd->hash_num + ST_DICT_GROUP_WIDTH) < 0) {
+            ST_ERROR("Failed to read ctrl");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    wd->node_pool = st_dict_alloc_nodes(wd, wd->max_pool_num);
+    if (wd->node_pool == NULL) {
+        ST_ERROR("Failed to alloc node_pool.");
+        return -1;
+    }
+    bzero(wd->node_pool, wd->node_size*wd->max_pool_num);
+
+    if (st_dict_read_array(fp, wd->node_pool, wd->node_size,
+                wd->cur_index) < 0) {
+        ST_ERROR("Failed to read node_pool");
+        return -1;
+    }
+
+    return 0;
+}
+
+st_dict_t* st_dict_load_from_bin(FILE *fp)
+{
+    st_dict_t *wd;
+
+    ST_CHECK_PARAM(fp == NULL, NULL);
+
+    if((wd = st_dict_alloc()) == NULL)
+    {
+        ST_ERROR("Failed to st_dict_alloc.");
+        return NULL;
+    }
+
+    if(st_dict_load(wd, fp) < 0)
+    {
+        ST_ERROR("Failed to st_dict_load.");
+        goto ERR;
+
+    }
+
+    return wd;
+ERR:
+    safe_st_dict_destroy(wd);
+    return NULL;
+}
+
+// use a saved dict in place, buf must be aligned to ST_DICT_ALIGN
+static int st_dict_map(st_dict_t *wd, const char *buf, size_t len)
+{
+    st_dict_header_t header;
+    size_t off;
+    size_t sz;
+
+    if (len < sizeof(header)) {
+        ST_ERROR("Buffer too small for header.");
+        return -1;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (st_dict_parse_header(wd, &header) < 0) {
+        ST_ERROR("Failed to st_dict_parse_header.");
+        return -1;
+    }
+    wd->read_only = true;
+
+    off = sizeof(header);
+    sz = wd->node_size * (size_t)wd->hash_num;
+    if (off + sz > len) {
+        ST_ERROR("Buffer too small for first_level_node.");
+        return -1;
+    }
+    wd->first_level_node = (st_dict_node_t *)(buf + off);
+    off += st_dict_align(sz);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        sz = (size_t)wd->hash_num + ST_DICT_GROUP_WIDTH;
+        if (off + sz > len) {
+            ST_ERROR("Buffer too small for ctrl.");
+            return -1;
+        }
+        wd->ctrl = (unsigned char *)(buf + off);
+    } else {
+        sz = wd->node_size * (size_t)wd->cur_index;
+        if (off + sz > len) {
+            ST_ERROR("Buffer too small for node_pool.");
+            return -1;
+        }
+        wd->node_pool = (wd->cur_index > 0) ? (st_dict_node_t *)(buf + off)
+                                             : NULL;
+        wd->max_pool_num = wd->cur_index;
+    }
+
+    return 0;
+}
+
+st_dict_t* st_dict_map_buf(const void *buf, size_t len)
+{
+    st_dict_t *wd = NULL;
+
+    ST_CHECK_PARAM(buf == NULL || ((uintptr_t)buf % ST_DICT_ALIGN) != 0,
+            NULL);
+
+    if ((wd = st_dict_alloc()) == NULL) {
+        ST_ERROR("Failed to st_dict_alloc.");
+        return NULL;
+    }
+
+    if (st_dict_map(wd, (const char *)buf, len) < 0) {
+        ST_ERROR("Failed to st_dict_map.");
+        goto ERR;
+    }
+
+    return wd;
+
+ERR:
+    safe_st_dict_destroy(wd);
+    return NULL;
+}
+
+st_dict_t* st_dict_mmap(const char *file)
+{
+    st_dict_t *wd = NULL;
+    struct stat st;
+    void *addr;
+    int fd = -1;
+
+    ST_CHECK_PARAM(file == NULL, NULL);
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        ST_ERROR("Failed to open file[%s].", file);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ST_ERROR("Failed to stat file[%s].", file);
+        goto ERR;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ST_ERROR("Failed to mmap file[%s].", file);
+        goto ERR;
+    }
+    safe_close(fd);
+
+    if ((wd = st_dict_alloc()) == NULL) {
+        ST_ERROR("Failed to st_dict_alloc.");
+        (void)munmap(addr, st.st_size);
+        goto ERR;
+    }
+    wd->map_addr = addr;
+    wd->map_len = st.st_size;
+
+    if (st_dict_map(wd, (const char *)addr, st.st_size) < 0) {
+        ST_ERROR("Failed to st_dict_map.");
+        goto ERR;
+    }
+
+    return wd;
+
+ERR:
+    safe_close(fd);
+    safe_st_dict_destroy(wd);
+    return NULL;
+}
+
+static int st_dict_traverse_buckets(st_dict_t *wd,
+        st_dict_node_t *first_level_node, st_dict_id_t from, st_dict_id_t to,
+        st_dict_trav_func_t trav, void *args)
+{
+    st_dict_node_t *work;
+    st_dict_node_t *node_pool;
+    st_dict_id_t id;
+    st_dict_id_t did;
+
+    node_pool = wd->node_pool;
+
+    for(id = from; id < to; id++) {
+        work = st_dict_at(wd, first_level_node, id);
+
+        if (work->sign1 == 0 && work->sign2 == 0) {
+            continue;
+        }
+
+        if(trav != NULL && trav(work, args) < 0) {
+            ST_ERROR("Failed to trav.");
+            return -1;
+        }
+
+        did = work->next;
+        while(did != ST_DICT_BAD_NODE) {
+            if(did >= wd->cur_index) {
+                ST_ERROR("illegal next");
+                return -1;
+            }
+
+            work = st_dict_at(wd, node_pool, did);
+            did = work->next;
+
+            assert(work->sign1 != 0 && work->sign2 != 0);
+
+            if(trav != NULL && trav(work, args) < 0) {
+                ST_ERROR("Failed to trav.");
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int st_dict_traverse(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
+{
+    ST_CHECK_PARAM(wd == NULL, -1);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_traverse(wd, 0, wd->hash_num, trav, args);
+    }
+
+    if (wd->old_first_level_node != NULL) {
+        if (st_dict_traverse_buckets(wd, wd->old_first_level_node,
+                    wd->rehash_idx, wd->old_hash_num, trav, args) < 0) {
+            ST_ERROR("Failed to st_dict_traverse_buckets.");
+            return -1;
         }
     }
 
-    return -1;
+    return st_dict_traverse_buckets(wd, wd->first_level_node,
+            0, wd->hash_num, trav, args);
+}
+
+/*
+ * Parallel traverse and bulk build.
+ *
+ * Work is split into nthreads ranges of buckets and run by st_run_threads.
+ */
+// [from, to) is the share of thread t among nthreads in n items
+static void st_dict_split(st_dict_id_t n, int nthreads, int t,
+        st_dict_id_t *from, st_dict_id_t *to)
+{
+    st_dict_id_t chunk;
+
+    chunk = n / nthreads + (n % nthreads != 0);
+    *from = min(n, chunk * t);
+    *to = min(n, *from + chunk);
+}
+
+typedef struct _st_dict_trav_arg_t_ {
+    st_dict_t *wd;
+    st_dict_trav_func_t trav;
+    void *args;
+    int nthreads;
+    int tid;
+    int ret;
+} st_dict_trav_arg_t;
+
+static void* st_dict_traverse_thread(void *arg)
+{
+    st_dict_trav_arg_t *targ = (st_dict_trav_arg_t *)arg;
+    st_dict_t *wd = targ->wd;
+    st_dict_id_t from;
+    st_dict_id_t to;
+
+    st_dict_split(wd->hash_num, targ->nthreads, targ->tid, &from, &to);
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        targ->ret = st_dict_open_traverse(wd, from, to,
+                targ->trav, targ->args);
+    } else {
+        targ->ret = st_dict_traverse_buckets(wd, wd->first_level_node,
+                from, to, targ->trav, targ->args);
+    }
+
+    return NULL;
 }
 
-int st_dict_save(st_dict_t *wd, FILE *fp)
+int st_dict_traverse_parallel(st_dict_t *wd, int nthreads,
+        st_dict_trav_func_t trav, void *args)
 {
-    size_t ret = 0;
-
-    ST_CHECK_PARAM(wd == NULL || fp == NULL, -1);
+    st_dict_trav_arg_t *targs;
+    int ret;
+    int t;
 
-    ret = fwrite(&wd->hash_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write hash_num");
-        return -1;
-    }
+    ST_CHECK_PARAM(wd == NULL || nthreads <= 0, -1);
 
-    ret = fwrite(&wd->realloc_node_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write realloc_node_num");
+    if (st_dict_rehash_finish(wd) < 0) {
+        ST_ERROR("Failed to st_dict_rehash_finish.");
         return -1;
     }
 
-    ret = fwrite(&wd->cur_index, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write cur_index");
+    targs = (st_dict_trav_arg_t *)st_malloc(sizeof(st_dict_trav_arg_t)
+            * nthreads);
+    if (targs == NULL) {
+        ST_ERROR("Failed to alloc targs.");
         return -1;
     }
-
-    ret = fwrite(&wd->max_pool_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write max_pool_num");
-        return -1;
+    for (t = 0; t < nthreads; t++) {
+        targs[t].wd = wd;
+        targs[t].trav = trav;
+        targs[t].args = args;
+        targs[t].nthreads = nthreads;
+        targs[t].tid = t;
+        targs[t].ret = 0;
     }
 
-    ret = fwrite(&wd->node_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write node_num");
-        return -1;
-    }
+    st_run_threads(st_dict_traverse_thread, targs,
+            sizeof(st_dict_trav_arg_t), nthreads);
 
-    ret = fwrite(&wd->addr_mask, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to write addr_mask");
-        return -1;
+    ret = 0;
+    for (t = 0; t < nthreads; t++) {
+        if (targs[t].ret < 0) {
+            ST_ERROR("Failed to traverse in thread[%d].", t);
+            ret = -1;
+        }
     }
+    safe_st_free(targs);
 
-    ret = fwrite(wd->first_level_node, sizeof(st_dict_node_t),
-        wd->hash_num, fp);
-    if(ret != (size_t)wd->hash_num)
-    {
-        ST_ERROR("Failed to write first_level_node");
-        return -1;
-    }
+    return ret;
+}
 
-    ret = fwrite(wd->node_pool, sizeof(st_dict_node_t),
-        wd->max_pool_num, fp);
-    if(ret != (size_t)wd->max_pool_num)
-    {
-        ST_ERROR("Failed to write node_pool");
-        return -1;
+/*
+ * Bulk build of chained dicts, in three parallel passes:
+ *  1. every thread hashes a slice of the nodes, counting how many fall in
+ *     the bucket range of each thread;
+ *  2. every thread scatters the ids of its slice into perm, grouped by
+ *     owner of the bucket;
+ *  3. every thread inserts the nodes of its bucket range, taking pooled
+ *     nodes from a range of node_pool reserved for it.
+ * Since no two threads touch the same bucket or pooled node, no lock is
+ * needed.
+ */
+typedef struct _st_dict_bulk_t_ {
+    st_dict_t *wd;
+    st_dict_node_t *nodes;
+    st_dict_id_t n;
+    int nthreads;
+    st_dict_id_t chunk; /* number of buckets owned by a thread. */
+    st_dict_id_t *keys; /* bucket of every node. */
+    st_dict_id_t *perm; /* ids of nodes, grouped by owner. */
+    st_dict_id_t *offsets; /* [slice][owner] position in perm. */
+    st_dict_id_t *starts; /* first position in perm of every owner. */
+    st_dict_id_t pool_base;
+} st_dict_bulk_t;
+
+typedef struct _st_dict_bulk_arg_t_ {
+    st_dict_bulk_t *bulk;
+    int tid;
+    st_dict_id_t added;
+    st_dict_id_t used; /* pooled nodes used. */
+    st_dict_id_t new_buckets;
+} st_dict_bulk_arg_t;
+
+static void* st_dict_bulk_hash(void *arg)
+{
+    st_dict_bulk_arg_t *barg = (st_dict_bulk_arg_t *)arg;
+    st_dict_bulk_t *bulk = barg->bulk;
+    st_dict_id_t *counts;
+    st_dict_node_t *pnode;
+    st_dict_id_t from;
+    st_dict_id_t to;
+    st_dict_id_t i;
+
+    counts = bulk->offsets + (size_t)barg->tid * bulk->nthreads;
+    st_dict_split(bulk->n, bulk->nthreads, barg->tid, &from, &to);
+    for (i = from; i < to; i++) {
+        pnode = st_dict_at(bulk->wd, bulk->nodes, i);
+        if (pnode->sign1 == 0 && pnode->sign2 == 0) {
+            bulk->keys[i] = ST_DICT_BAD_NODE;
+            continue;
+        }
+        bulk->keys[i] = bulk->wd->hash_func(bulk->wd, pnode);
+        counts[bulk->keys[i] / bulk->chunk]++;
     }
 
-    fflush(fp);
-
-    return 0;
+    return NULL;
 }
 
-int st_dict_load(st_dict_t *wd, FILE *fp)
+static void* st_dict_bulk_scatter(void *arg)
 {
-    size_t ret = 0;
-
-    ST_CHECK_PARAM(wd == NULL || fp == NULL, -1);
-
-    ret = fread(&wd->hash_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read hash_num");
-        return -1;
+    st_dict_bulk_arg_t *barg = (st_dict_bulk_arg_t *)arg;
+    st_dict_bulk_t *bulk = barg->bulk;
+    st_dict_id_t *offsets;
+    st_dict_id_t from;
+    st_dict_id_t to;
+    st_dict_id_t i;
+
+    offsets = bulk->offsets + (size_t)barg->tid * bulk->nthreads;
+    st_dict_split(bulk->n, bulk->nthreads, barg->tid, &from, &to);
+    for (i = from; i < to; i++) {
+        if (bulk->keys[i] != ST_DICT_BAD_NODE) {
+            bulk->perm[offsets[bulk->keys[i] / bulk->chunk]++] = i;
+        }
     }
 
-    ret = fread(&wd->realloc_node_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read realloc_node_num");
-        return -1;
-    }
+    return NULL;
+}
 
-    ret = fread(&wd->cur_index, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read cur_index");
-        return -1;
-    }
+static void* st_dict_bulk_insert(void *arg)
+{
+    st_dict_bulk_arg_t *barg = (st_dict_bulk_arg_t *)arg;
+    st_dict_bulk_t *bulk = barg->bulk;
+    st_dict_t *wd = bulk->wd;
+    st_dict_node_t *pnode;
+    st_dict_node_t *work;
+    st_dict_node_t *node;
+    st_dict_id_t start;
+    st_dict_id_t did;
+    st_dict_id_t j;
 
-    ret = fread(&wd->max_pool_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read max_pool_num");
-        return -1;
-    }
+    start = bulk->starts[barg->tid];
+    for (j = start; j < bulk->starts[barg->tid + 1]; j++) {
+        pnode = st_dict_at(wd, bulk->nodes, bulk->perm[j]);
+        work = st_dict_at(wd, wd->first_level_node,
+                bulk->keys[bulk->perm[j]]);
+        if (work->sign1 == 0 && work->sign2 == 0) {
+            st_dict_copy_data(wd, work, pnode);
+            work->next = ST_DICT_BAD_NODE;
+            st_dict_store_signs(work, pnode);
+            if (wd->clear_nodes != NULL) {
+                // perm[j] is consumed, so the slot can hold the bucket
+                bulk->perm[start + barg->new_buckets]
+                    = bulk->keys[bulk->perm[j]];
+            }
+            barg->new_buckets++;
+            barg->added++;
+            continue;
+        }
 
-    ret = fread(&wd->node_num, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read node_num");
-        return -1;
-    }
+        node = work;
+        while (node != NULL && !wd->node_eq_func(node, pnode, NULL)) {
+            did = node->next;
+            node = (did == ST_DICT_BAD_NODE) ? NULL
+                                             : st_dict_at(wd, wd->node_pool, did);
+        }
+        if (node != NULL) {
+            continue;
+        }
 
-    ret = fread(&wd->addr_mask, sizeof(st_dict_id_t), 1, fp);
-    if(ret != 1)
-    {
-        ST_ERROR("Failed to read addr_mask");
-        return -1;
+        did = bulk->pool_base + start + barg->used++;
+        node = st_dict_at(wd, wd->node_pool, did);
+        node->sign1 = pnode->sign1;
+        node->sign2 = pnode->sign2;
+        st_dict_copy_data(wd, node, pnode);
+        node->next = work->next;
+        __atomic_store_n(&work->next, did, __ATOMIC_RELEASE);
+        barg->added++;
     }
 
-    wd->first_level_node = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t)*wd->hash_num);
-    if(wd->first_level_node == NULL)
-    {
-        ST_ERROR("Failed to alloc first_level_node.");
-        return -1;
-    }
+    return NULL;
+}
 
-    wd->node_pool = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t)*wd->max_pool_num);
-    if(wd->node_pool == NULL)
-    {
-        ST_ERROR("Failed to alloc node_pool.");
+// grow first_level_node up front instead of rehashing while inserting
+static int st_dict_bulk_presize(st_dict_t *wd, st_dict_id_t n)
+{
+    if (st_dict_rehash_finish(wd) < 0) {
+        ST_ERROR("Failed to st_dict_rehash_finish.");
         return -1;
     }
 
-    ret = fread(wd->first_level_node, sizeof(st_dict_node_t),
-        wd->hash_num, fp);
-    if(ret != wd->hash_num)
-    {
-        ST_ERROR("Failed to read first_level_node");
-        return -1;
+    if (wd->max_load_factor <= 0) {
+        return 0;
     }
 
-    ret = fread(wd->node_pool, sizeof(st_dict_node_t),
-        wd->max_pool_num, fp);
-    if(ret != wd->max_pool_num)
-    {
-        ST_ERROR("Failed to read node_pool");
-        return -1;
+    while (wd->node_num + n >= wd->max_load_factor * wd->hash_num) {
+        if (st_dict_rehash_start(wd) < 0) {
+            ST_ERROR("Failed to st_dict_rehash_start.");
+            return -1;
+        }
+        if (wd->old_first_level_node == NULL) {
+            break;
+        }
+        if (st_dict_rehash_finish(wd) < 0) {
+            ST_ERROR("Failed to st_dict_rehash_finish.");
+            return -1;
+        }
     }
 
     return 0;
 }
 
-st_dict_t* st_dict_load_from_bin(FILE *fp)
+static st_dict_id_t st_dict_build_serial(st_dict_t *wd,
+        st_dict_node_t *nodes, st_dict_id_t n)
 {
-    st_dict_t *wd;
+    st_dict_node_t *pnode;
+    st_dict_id_t added;
+    st_dict_id_t i;
+
+    added = 0;
+    for (i = 0; i < n; i++) {
+        pnode = st_dict_at(wd, nodes, i);
+        if (pnode->sign1 == 0 && pnode->sign2 == 0) {
+            continue;
+        }
+        if (st_dict_find(wd, pnode, NULL) != NULL) {
+            continue;
+        }
+        if (st_dict_add_no_seek(wd, pnode) < 0) {
+            ST_ERROR("Failed to st_dict_add_no_seek.");
+            return ST_DICT_BAD_NODE;
+        }
+        added++;
+    }
 
-    ST_CHECK_PARAM(fp == NULL, NULL);
+    return added;
+}
 
-    if((wd = st_dict_alloc()) == NULL)
-    {
-        ST_ERROR("Failed to st_dict_alloc.");
-        return NULL;
+st_dict_id_t st_dict_build_bulk(st_dict_t *wd, st_dict_node_t *nodes,
+        st_dict_id_t n, int nthreads)
+{
+    st_dict_bulk_t bulk;
+    st_dict_bulk_arg_t *bargs = NULL;
+    st_dict_id_t added;
+    st_dict_id_t pos;
+    st_dict_id_t i;
+    int t, o;
+
+    ST_CHECK_PARAM(wd == NULL || (nodes == NULL && n > 0) || nthreads <= 0
+            || wd->read_only, ST_DICT_BAD_NODE);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_build_serial(wd, nodes, n);
     }
 
-    if(st_dict_load(wd, fp) < 0)
-    {
-        ST_ERROR("Failed to st_alphabet_load_txt_fp.");
+    memset(&bulk, 0, sizeof(bulk));
+    if (st_dict_bulk_presize(wd, n) < 0) {
+        ST_ERROR("Failed to st_dict_bulk_presize.");
+        return ST_DICT_BAD_NODE;
+    }
+
+    // every node may need a pooled node
+    if (st_dict_reserve_pool(wd, n) < 0) {
+        ST_ERROR("Failed to st_dict_reserve_pool.");
+        return ST_DICT_BAD_NODE;
+    }
+    bulk.pool_base = wd->cur_index;
+    __atomic_store_n(&wd->cur_index, wd->cur_index + n, __ATOMIC_RELAXED);
+
+    bulk.wd = wd;
+    bulk.nodes = nodes;
+    bulk.n = n;
+    bulk.nthreads = nthreads;
+    bulk.chunk = wd->hash_num / nthreads + (wd->hash_num % nthreads != 0);
+    bulk.keys = (st_dict_id_t *)st_malloc(sizeof(st_dict_id_t) * max(n, 1));
+    bulk.perm = (st_dict_id_t *)st_malloc(sizeof(st_dict_id_t) * max(n, 1));
+    bulk.offsets = (st_dict_id_t *)st_malloc(sizeof(st_dict_id_t)
+            * nthreads * nthreads);
+    bulk.starts = (st_dict_id_t *)st_malloc(sizeof(st_dict_id_t)
+            * (nthreads + 1));
+    bargs = (st_dict_bulk_arg_t *)st_malloc(sizeof(st_dict_bulk_arg_t)
+            * nthreads);
+    if (bulk.keys == NULL || bulk.perm == NULL || bulk.offsets == NULL
+            || bulk.starts == NULL || bargs == NULL) {
+        ST_ERROR("Failed to alloc mem for bulk build.");
         goto ERR;
+    }
+    memset(bulk.offsets, 0, sizeof(st_dict_id_t) * nthreads * nthreads);
+    memset(bargs, 0, sizeof(st_dict_bulk_arg_t) * nthreads);
+    for (t = 0; t < nthreads; t++) {
+        bargs[t].bulk = &bulk;
+        bargs[t].tid = t;
+    }
 
+    st_run_threads(st_dict_bulk_hash, bargs,
+            sizeof(st_dict_bulk_arg_t), nthreads);
+
+    // counts to offsets, owner by owner
+    pos = 0;
+    for (o = 0; o < nthreads; o++) {
+        bulk.starts[o] = pos;
+        for (t = 0; t < nthreads; t++) {
+            i = bulk.offsets[t * nthreads + o];
+            bulk.offsets[t * nthreads + o] = pos;
+            pos += i;
+        }
     }
+    bulk.starts[nthreads] = pos;
+
+    st_run_threads(st_dict_bulk_scatter, bargs,
+            sizeof(st_dict_bulk_arg_t), nthreads);
+    st_run_threads(st_dict_bulk_insert, bargs,
+            sizeof(st_dict_bulk_arg_t), nthreads);
+
+    added = 0;
+    for (o = 0; o < nthreads; o++) {
+        added += bargs[o].added;
+        if (wd->clear_nodes != NULL) {
+            memcpy(wd->clear_nodes + wd->clear_node_num,
+                    bulk.perm + bulk.starts[o],
+                    sizeof(st_dict_id_t) * bargs[o].new_buckets);
+            wd->clear_node_num += bargs[o].new_buckets;
+        }
+        // give back the reserved pooled nodes left
+        for (i = bulk.starts[o] + bargs[o].used;
+                i < bulk.starts[o + 1]; i++) {
+            st_dict_free_node(wd, bulk.pool_base + i);
+        }
+    }
+    for (i = pos; i < n; i++) {
+        st_dict_free_node(wd, bulk.pool_base + i);
+    }
+    wd->node_num += added;
 
-    wd->hash_func = st_dict_hash_simple;
-    wd->node_eq_func = st_dict_node_equal;
+    safe_st_free(bulk.keys);
+    safe_st_free(bulk.perm);
+    safe_st_free(bulk.offsets);
+    safe_st_free(bulk.starts);
+    safe_st_free(bargs);
+
+    return added;
 
-    return wd;
 ERR:
-    safe_st_dict_destroy(wd);
-    return NULL;
+    for (i = 0; i < n; i++) {
+        st_dict_free_node(wd, bulk.pool_base + i);
+    }
+    safe_st_free(bulk.keys);
+    safe_st_free(bulk.perm);
+    safe_st_free(bulk.offsets);
+    safe_st_free(bulk.starts);
+    safe_st_free(bargs);
+    return ST_DICT_BAD_NODE;
 }
 
-int st_dict_traverse(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
+// number of groups probed before the group holding slot i
+static st_dict_id_t st_dict_open_distance(st_dict_t *wd, st_dict_id_t i)
 {
-    st_dict_node_t *work;
-    st_dict_node_t *first_level_node;
-    st_dict_node_t *node_pool;
-    st_dict_id_t id;
-    st_dict_id_t did;
+    st_dict_node_t *node;
+    st_dict_id_t pos;
+    st_dict_id_t step;
+    st_dict_id_t dist;
+
+    node = st_dict_at(wd, wd->first_level_node, i);
+    pos = wd->hash_func(wd, node);
+    step = 0;
+    for (dist = 0; ((i - pos) & wd->addr_mask) >= ST_DICT_GROUP_WIDTH;
+            dist++) {
+        step += ST_DICT_GROUP_WIDTH;
+        pos = (pos + step) & wd->addr_mask;
+    }
 
-    ST_CHECK_PARAM(wd == NULL, -1);
+    return dist;
+}
 
-    first_level_node = wd->first_level_node;
-    node_pool = wd->node_pool;
+static void st_dict_hist_add(st_dict_id_t *hist, int n, st_dict_id_t len)
+{
+    hist[min(len, (st_dict_id_t)(n - 1))]++;
+}
 
-    for(id = 0; id < wd->hash_num; id++) {
-        work = first_level_node + id;
+static st_dict_id_t st_dict_chain_hist_buckets(st_dict_t *wd,
+        st_dict_node_t *first_level_node, st_dict_id_t from, st_dict_id_t to,
+        st_dict_id_t *hist, int n)
+{
+    st_dict_node_t *work;
+    st_dict_id_t max_len;
+    st_dict_id_t len;
+    st_dict_id_t id;
 
-        if (work->sign1 == 0 && work->sign2 == 0) {
-            continue;
+    max_len = 0;
+    for (id = from; id < to; id++) {
+        work = st_dict_at(wd, first_level_node, id);
+        len = 0;
+        if (work->sign1 != 0 || work->sign2 != 0) {
+            for (len = 1; work->next != ST_DICT_BAD_NODE; len++) {
+                work = st_dict_at(wd, wd->node_pool, work->next);
+            }
         }
+        st_dict_hist_add(hist, n, len);
+        max_len = max(max_len, len);
+    }
 
-        if(trav != NULL && trav(work, args) < 0) {
-            ST_ERROR("Failed to trav.");
-            return -1;
-        }
+    return max_len;
+}
 
-        did = work->next;
-        while(did != ST_DICT_BAD_NODE) {
-            if(did >= wd->cur_index) {
-                ST_ERROR("illegal next");
-                return -1;
-            }
+st_dict_id_t st_dict_chain_hist(st_dict_t *wd, st_dict_id_t *hist, int n)
+{
+    st_dict_id_t max_len;
+    st_dict_id_t dist;
+    st_dict_id_t id;
 
-            work = node_pool + did;
-            did = work->next;
+    ST_CHECK_PARAM(wd == NULL || hist == NULL || n <= 0, ST_DICT_BAD_NODE);
 
-            assert(work->sign1 != 0 && work->sign2 != 0);
+    memset(hist, 0, sizeof(st_dict_id_t) * n);
 
-            if(trav != NULL && trav(work, args) < 0) {
-                ST_ERROR("Failed to trav.");
-                return -1;
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        max_len = 0;
+        for (id = 0; id < wd->hash_num; id++) {
+            if (!st_dict_ctrl_is_full(wd->ctrl[id])) {
+                continue;
             }
+            dist = st_dict_open_distance(wd, id);
+            st_dict_hist_add(hist, n, dist);
+            max_len = max(max_len, dist);
         }
+
+        return max_len;
     }
 
-    return 0;
+    max_len = st_dict_chain_hist_buckets(wd, wd->first_level_node,
+            0, wd->hash_num, hist, n);
+    if (wd->old_first_level_node != NULL) {
+        dist = st_dict_chain_hist_buckets(wd, wd->old_first_level_node,
+                wd->rehash_idx, wd->old_hash_num, hist, n);
+        max_len = max(max_len, dist);
+    }
+
+    return max_len;
 }
 
 int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
@@ -557,9 +2542,14 @@ int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
     st_dict_id_t   *clear_nodes;
     st_dict_id_t id;
     st_dict_id_t did;
+    st_dict_id_t next;
     st_dict_id_t clear_node_num;
 
-    ST_CHECK_PARAM(wd == NULL || wd->clear_nodes == NULL, -1);
+    ST_CHECK_PARAM(wd == NULL || wd->clear_nodes == NULL || wd->read_only, -1);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        return st_dict_open_clear(wd, trav, args);
+    }
 
     first_level_node = wd->first_level_node;
     node_pool = wd->node_pool;
@@ -568,7 +2558,7 @@ int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
 
     for(id = 0; id < clear_node_num; id++)
     {
-        work = first_level_node + clear_nodes[id];
+        work = st_dict_at(wd, first_level_node, clear_nodes[id]);
 
         assert(work->sign1 != 0 || work->sign2 != 0);
 
@@ -583,6 +2573,7 @@ int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
         work->sign2 = 0;
         work->uint1 = 0;
         did = work->next;
+        work->next = ST_DICT_BAD_NODE;
         while(did != ST_DICT_BAD_NODE)
         {
             if(did >= wd->cur_index)
@@ -591,8 +2582,7 @@ int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
                 return -1;
             }
 
-            work = node_pool + did;
-            did = work->next;
+            work = st_dict_at(wd, node_pool, did);
 
             assert(work->sign1 != 0 && work->sign2 != 0);
 
@@ -603,15 +2593,20 @@ int st_dict_clear(st_dict_t *wd, st_dict_trav_func_t trav, void *args)
             }
 
             wd->node_num--;
-            work->sign1 = 0;
-            work->sign2 = 0;
-            work->uint1 = 0;
-            work->next = ST_DICT_BAD_NODE;
+            next = work->next;
+            st_dict_free_node(wd, did);
+            did = next;
         }
     }
 
     wd->clear_node_num = 0;
 
+    // all pooled nodes are free, start over
+    if (wd->node_num == 0) {
+        wd->cur_index = 0;
+        wd->free_head = ST_DICT_BAD_NODE;
+    }
+
     return 0;
 }
 
@@ -619,14 +2614,24 @@ int st_dict_update(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg,
         st_dict_update_func_t update_data)
 {
     st_dict_id_t hash_key;
-    st_dict_id_t ret;
     st_dict_node_t *work;
 
     ST_CHECK_PARAM(pnode == NULL
-            || (pnode->sign1 == 0 && pnode->sign2 == 0), -1);
+            || (pnode->sign1 == 0 && pnode->sign2 == 0) || wd->read_only, -1);
+
+    if (wd->engine == ST_DICT_ENGINE_OPEN) {
+        work = st_dict_open_find(wd, pnode, node_eq_arg);
+        if (work == NULL) {
+            return st_dict_open_add(wd, pnode);
+        }
+        if (update_data(work, pnode->float1) < 0) {
+            ST_ERROR("Failed to update_data.");
+            return -1;
+        }
+        return 0;
+    }
 
-    hash_key = wd->hash_func(wd, pnode);
-    work = wd->first_level_node + hash_key;
+    work = st_dict_bucket(wd, pnode, &hash_key);
     if(wd->node_eq_func(work, pnode, node_eq_arg))
     {
         if(update_data(work, pnode->float1) < 0)
@@ -644,7 +2649,7 @@ int st_dict_update(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg,
             ST_ERROR("illegal next");
             return -1;
         }
-        work = wd->node_pool + work->next;
+        work = st_dict_at(wd, wd->node_pool, work->next);
         if(wd->node_eq_func(work, pnode, node_eq_arg))
         {
             if(update_data(work, pnode->float1) < 0)
@@ -656,32 +2661,7 @@ int st_dict_update(st_dict_t *wd, st_dict_node_t *pnode, void *node_eq_arg,
         }
     }
 
-    work = wd->first_level_node + hash_key;
-    if(work->sign1 == 0 && work->sign2 == 0)
-    {
-        work->sign1 = pnode->sign1;
-        work->sign2 = pnode->sign2;
-        work->uint1 = pnode->uint1;
-        work->next = ST_DICT_BAD_NODE;
-
-        if(wd->clear_nodes != NULL)
-        {
-            wd->clear_nodes[wd->clear_node_num++] = hash_key;
-        }
-    }
-    else
-    {
-        ret = st_dict_add_in(wd, pnode);
-        if(ret == ST_DICT_BAD_NODE)
-        {
-            ST_ERROR("Failed to add in node");
-            return -1;
-        }
-        wd->node_pool[ret].next = work->next;
-        work->next = ret;
-    }
-    wd->node_num++;
-    return 0;
+    return st_dict_chain_add(wd, pnode);
 }
 
 st_dict_t* st_dict_dup(st_dict_t *d)
@@ -690,6 +2670,11 @@ st_dict_t* st_dict_dup(st_dict_t *d)
 
     ST_CHECK_PARAM(d == NULL, NULL);
 
+    if (st_dict_rehash_finish(d) < 0) {
+        ST_ERROR("Failed to st_dict_rehash_finish.");
+        return NULL;
+    }
+
     dict = (st_dict_t *)st_malloc(sizeof(st_dict_t));
     if(dict == NULL) {
         ST_ERROR("Failed to alloc mem for st_dict.");
@@ -703,29 +2688,46 @@ st_dict_t* st_dict_dup(st_dict_t *d)
     dict->cur_index = d->cur_index;
     dict->max_pool_num = d->max_pool_num;
     dict->node_num = d->node_num;
+    dict->free_head = d->free_head;
+    dict->deleted_num = d->deleted_num;
     dict->clear_node_num = d->clear_node_num;
 
     dict->hash_func = d->hash_func;
     dict->node_eq_func = d->node_eq_func;
+    dict->value_size = d->value_size;
+    dict->node_size = d->node_size;
+    dict->engine = d->engine;
+    dict->max_load_factor = d->max_load_factor;
+    dict->concurrent = d->concurrent;
 
-    dict->first_level_node = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t) * dict->hash_num);
+    dict->first_level_node = st_dict_alloc_nodes(dict, dict->hash_num);
     if(dict->first_level_node == NULL) {
         ST_ERROR("Failed to alloc mem for first_level_node.");
         goto ERR;
     }
     memcpy(dict->first_level_node, d->first_level_node,
-            sizeof(st_dict_node_t)*dict->hash_num);
+            dict->node_size*dict->hash_num);
 
-    dict->node_pool = (st_dict_node_t *)
-        st_malloc(sizeof(st_dict_node_t)*dict->max_pool_num);
-    if(dict->node_pool == NULL) {
-        ST_ERROR("Failed to alloc mem for node_pool.");
-        goto ERR;
+    if (d->node_pool != NULL) {
+        dict->node_pool = st_dict_alloc_nodes(dict, dict->max_pool_num);
+        if(dict->node_pool == NULL) {
+            ST_ERROR("Failed to alloc mem for node_pool.");
+            goto ERR;
+        }
+
+        memcpy(dict->node_pool, d->node_pool,
+                dict->node_size*dict->max_pool_num);
     }
 
-    memcpy(dict->node_pool, d->node_pool,
-            sizeof(st_dict_node_t)*dict->max_pool_num);
+    if (d->ctrl != NULL) {
+        dict->ctrl = (unsigned char *)
+            st_malloc(dict->hash_num + ST_DICT_GROUP_WIDTH);
+        if(dict->ctrl == NULL) {
+            ST_ERROR("Failed to alloc mem for ctrl.");
+            goto ERR;
+        }
+        memcpy(dict->ctrl, d->ctrl, dict->hash_num + ST_DICT_GROUP_WIDTH);
+    }
 
     if(d->clear_nodes != NULL) {
         dict->clear_nodes = (st_dict_id_t *)
@@ -0,0 +1,706 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "st_utils.h"
+#include "st_log.h"
+#include "st_mem.h"
+#include "st_trie.h"
+
+#define ST_TRIE_CODE_NUM 257 /* end of label and 256 bytes. */
+
+void st_trie_destroy(st_trie_t *trie)
+{
+    if (trie == NULL) {
+        return;
+    }
+
+    if (trie->map_addr != NULL) {
+        (void)munmap(trie->map_addr, trie->map_len);
+        trie->map_addr = NULL;
+        trie->map_len = 0;
+        trie->units = NULL;
+    }
+
+    safe_st_free(trie->units);
+    trie->size = 0;
+    trie->label_num = 0;
+}
+
+static st_trie_t* st_trie_alloc()
+{
+    st_trie_t *trie;
+
+    trie = (st_trie_t *)st_malloc(sizeof(st_trie_t));
+    if (trie == NULL) {
+        ST_ERROR("Failed to st_malloc trie.");
+        return NULL;
+    }
+    memset(trie, 0, sizeof(st_trie_t));
+
+    return trie;
+}
+
+/*
+ * Build.
+ *
+ * Labels are sorted, then the trie is built depth first. The children of a
+ * node are placed together at the first base where all their units are
+ * free, searched from next_check_pos, which moves forward once the units
+ * before it are mostly used.
+ */
+typedef struct _st_trie_builder_t_ {
+    st_trie_t *trie;
+    st_alphabet_t *alphabet;
+    int *ids; /* sorted by label. */
+    int next_check_pos;
+} st_trie_builder_t;
+
+static int st_trie_label_cmp(const void *a, const void *b, void *args)
+{
+    st_alphabet_t *alphabet = (st_alphabet_t *)args;
+    int r;
+
+    r = strcmp(st_alphabet_get_label(alphabet, *(const int *)a),
+            st_alphabet_get_label(alphabet, *(const int *)b));
+    if (r != 0) {
+        return r;
+    }
+
+    return *(const int *)a - *(const int *)b;
+}
+
+static int st_trie_resize(st_trie_t *trie, int size)
+{
+    st_trie_unit_t *units;
+    int i;
+
+    if (size <= trie->size) {
+        return 0;
+    }
+
+    size = max(size, trie->size * 2);
+    units = (st_trie_unit_t *)st_realloc(trie->units,
+            sizeof(st_trie_unit_t) * size);
+    if (units == NULL) {
+        ST_ERROR("Failed to st_realloc units. [%d]", size);
+        return -1;
+    }
+    for (i = trie->size; i < size; i++) {
+        units[i].base = 0;
+        units[i].check = -1;
+    }
+    trie->units = units;
+    trie->size = size;
+
+    return 0;
+}
+
+// code of label at depth, 0 at its end
+static int st_trie_code(const char *label, int depth)
+{
+    return (label[depth] == '\0') ? 0 : (unsigned char)label[depth] + 1;
+}
+
+static int st_trie_find_base(st_trie_builder_t *builder, int *codes, int n)
+{
+    st_trie_t *trie = builder->trie;
+    int nonzero_num;
+    int first;
+    int pos;
+    int b;
+    int i;
+
+    pos = max(codes[0] + 1, builder->next_check_pos) - 1;
+    nonzero_num = 0;
+    first = 0;
+    while (true) {
+        pos++;
+        if (st_trie_resize(trie, pos + ST_TRIE_CODE_NUM) < 0) {
+            ST_ERROR("Failed to st_trie_resize.");
+            return -1;
+        }
+
+        if (trie->units[pos].check >= 0) {
+            nonzero_num++;
+            continue;
+        } else if (!first) {
+            builder->next_check_pos = pos;
+            first = 1;
+        }
+
+        b = pos - codes[0];
+        if (b < 1) {
+            continue;
+        }
+        for (i = 1; i < n; i++) {
+            if (trie->units[b + codes[i]].check >= 0) {
+                break;
+            }
+        }
+        if (i == n) {
+            break;
+        }
+    }
+
+    // units before pos are crowded, start from pos next time
+    if (nonzero_num * 20 >= (pos - builder->next_check_pos + 1) * 19) {
+        builder->next_check_pos = pos;
+    }
+
+    return b;
+}
+
+typedef struct _st_trie_frame_t_ {
+    int s;
+    int left;
+    int right;
+    int depth;
+} st_trie_frame_t;
+
+// build node s with labels [left, right), which share depth bytes.
+// pending nodes are kept in frames, children are popped in code order,
+// so units are placed as a depth first walk would place them.
+static int st_trie_build_node(st_trie_builder_t *builder,
+        st_trie_frame_t *frames, int s, int left, int right, int depth)
+{
+    st_trie_t *trie = builder->trie;
+    int codes[ST_TRIE_CODE_NUM];
+    int starts[ST_TRIE_CODE_NUM + 1];
+    const char *label;
+    int num_frames;
+    int n, i, c, b;
+
+    frames[0].s = s;
+    frames[0].left = left;
+    frames[0].right = right;
+    frames[0].depth = depth;
+    num_frames = 1;
+    while (num_frames > 0) {
+        num_frames--;
+        s = frames[num_frames].s;
+        left = frames[num_frames].left;
+        right = frames[num_frames].right;
+        depth = frames[num_frames].depth;
+
+        n = 0;
+        for (i = left; i < right; i++) {
+            label = st_alphabet_get_label(builder->alphabet, builder->ids[i]);
+            c = st_trie_code(label, depth);
+            if (n > 0 && codes[n - 1] == c) {
+                continue;
+            }
+            codes[n] = c;
+            starts[n] = i;
+            n++;
+        }
+        starts[n] = right;
+
+        b = st_trie_find_base(builder, codes, n);
+        if (b < 0) {
+            ST_ERROR("Failed to st_trie_find_base.");
+            return -1;
+        }
+        trie->units[s].base = b;
+        for (i = 0; i < n; i++) {
+            trie->units[b + codes[i]].check = s;
+        }
+
+        // every pending frame holds its own labels, at most label_num
+        for (i = n - 1; i >= 0; i--) {
+            if (codes[i] == 0) {
+                // the smallest id comes first among equal labels
+                trie->units[b].base = -(builder->ids[starts[i]] + 1);
+                continue;
+            }
+            frames[num_frames].s = b + codes[i];
+            frames[num_frames].left = starts[i];
+            frames[num_frames].right = starts[i + 1];
+            frames[num_frames].depth = depth + 1;
+            num_frames++;
+        }
+    }
+
+    return 0;
+}
+
+st_trie_t* st_trie_build(st_alphabet_t *alphabet)
+{
+    st_trie_builder_t builder;
+    st_trie_frame_t *frames = NULL;
+    st_trie_unit_t *units;
+    st_trie_t *trie = NULL;
+    int *ids = NULL;
+    int label_num;
+    int size;
+    int i;
+
+    ST_CHECK_PARAM(alphabet == NULL, NULL);
+
+    label_num = st_alphabet_get_label_num(alphabet);
+    if (label_num <= 0) {
+        ST_ERROR("Empty alphabet.");
+        return NULL;
+    }
+
+    trie = st_trie_alloc();
+    if (trie == NULL) {
+        ST_ERROR("Failed to st_trie_alloc.");
+        goto ERR;
+    }
+    trie->label_num = label_num;
+
+    ids = (int *)st_malloc(sizeof(int) * label_num);
+    frames = (st_trie_frame_t *)st_malloc(sizeof(st_trie_frame_t)
+            * label_num);
+    if (ids == NULL || frames == NULL) {
+        ST_ERROR("Failed to st_malloc ids.");
+        goto ERR;
+    }
+    for (i = 0; i < label_num; i++) {
+        ids[i] = i;
+    }
+    st_qsort(ids, label_num, sizeof(int), st_trie_label_cmp, alphabet);
+
+    if (st_trie_resize(trie, ST_TRIE_CODE_NUM + 1) < 0) {
+        ST_ERROR("Failed to st_trie_resize.");
+        goto ERR;
+    }
+    trie->units[0].check = 0;
+
+    builder.trie = trie;
+    builder.alphabet = alphabet;
+    builder.ids = ids;
+    builder.next_check_pos = 0;
+    if (st_trie_build_node(&builder, frames, 0, 0, label_num, 0) < 0) {
+        ST_ERROR("Failed to st_trie_build_node.");
+        goto ERR;
+    }
+
+    // drop the free units at the end
+    for (size = trie->size; size > 1 && trie->units[size - 1].check < 0;
+            size--);
+    units = (st_trie_unit_t *)st_realloc(trie->units,
+            sizeof(st_trie_unit_t) * size);
+    if (units != NULL) {
+        trie->units = units;
+        trie->size = size;
+    }
+
+    safe_st_free(ids);
+    safe_st_free(frames);
+    return trie;
+
+ERR:
+    safe_st_free(ids);
+    safe_st_free(frames);
+    safe_st_trie_destroy(trie);
+    return NULL;
+}
+
+/*
+ * Search.
+ */
+
+// child of s on code, -1 if none
+static inline int st_trie_child(st_trie_t *trie, int s, int code)
+{
+    int t;
+
+    t = trie->units[s].base + code;
+    if ((unsigned int)t >= (unsigned int)trie->size
+            || trie->units[t].check != s) {
+        return -1;
+    }
+
+    return t;
+}
+
+// id of the label ending at node s, -1 if none
+static inline int st_trie_label_id(st_trie_t *trie, int s)
+{
+    int t;
+
+    t = st_trie_child(trie, s, 0);
+    if (t < 0) {
+        return -1;
+    }
+
+    return -trie->units[t].base - 1;
+}
+
+int st_trie_find(st_trie_t *trie, const char *key, size_t len)
+{
+    size_t i;
+    int s;
+
+    ST_CHECK_PARAM(trie == NULL || key == NULL, -1);
+
+    s = 0;
+    for (i = 0; i < len; i++) {
+        s = st_trie_child(trie, s, (unsigned char)key[i] + 1);
+        if (s < 0) {
+            return -1;
+        }
+    }
+
+    return st_trie_label_id(trie, s);
+}
+
+int st_trie_longest_match(st_trie_t *trie, const char *buf, size_t len,
+        int *match_len)
+{
+    size_t i;
+    int best;
+    int id;
+    int s;
+
+    ST_CHECK_PARAM(trie == NULL || buf == NULL, -1);
+
+    best = -1;
+    s = 0;
+    for (i = 0; ; i++) {
+        id = st_trie_label_id(trie, s);
+        if (id >= 0) {
+            best = id;
+            if (match_len != NULL) {
+                *match_len = (int)i;
+            }
+        }
+
+        if (i >= len) {
+            break;
+        }
+        s = st_trie_child(trie, s, (unsigned char)buf[i] + 1);
+        if (s < 0) {
+            break;
+        }
+    }
+
+    return best;
+}
+
+int st_trie_common_prefix(st_trie_t *trie, const char *buf, size_t len,
+        int *ids, int *lens, int max_num)
+{
+    size_t i;
+    int n;
+    int id;
+    int s;
+
+    ST_CHECK_PARAM(trie == NULL || buf == NULL || ids == NULL
+            || max_num < 0, -1);
+
+    n = 0;
+    s = 0;
+    for (i = 0; n < max_num; i++) {
+        id = st_trie_label_id(trie, s);
+        if (id >= 0) {
+            ids[n] = id;
+            if (lens != NULL) {
+                lens[n] = (int)i;
+            }
+            n++;
+        }
+
+        if (i >= len) {
+            break;
+        }
+        s = st_trie_child(trie, s, (unsigned char)buf[i] + 1);
+        if (s < 0) {
+            break;
+        }
+    }
+
+    return n;
+}
+
+static int st_trie_enum_node(st_trie_t *trie, int s,
+        st_trie_enum_func_t func, void *args)
+{
+    int num;
+    int ret;
+    int c, t;
+
+    num = 0;
+    for (c = 0; c < ST_TRIE_CODE_NUM; c++) {
+        t = st_trie_child(trie, s, c);
+        if (t < 0) {
+            continue;
+        }
+
+        if (c == 0) {
+            if (func != NULL && func(-trie->units[t].base - 1, args) < 0) {
+                ST_ERROR("Failed to func.");
+                return -1;
+            }
+            num++;
+            continue;
+        }
+
+        ret = st_trie_enum_node(trie, t, func, args);
+        if (ret < 0) {
+            return -1;
+        }
+        num += ret;
+    }
+
+    return num;
+}
+
+int st_trie_enumerate(st_trie_t *trie, const char *prefix, size_t len,
+        st_trie_enum_func_t func, void *args)
+{
+    size_t i;
+    int s;
+
+    ST_CHECK_PARAM(trie == NULL || (prefix == NULL && len > 0), -1);
+
+    s = 0;
+    for (i = 0; i < len; i++) {
+        s = st_trie_child(trie, s, (unsigned char)prefix[i] + 1);
+        if (s < 0) {
+            return 0;
+        }
+    }
+
+    return st_trie_enum_node(trie, s, func, args);
+}
+
+/*
+ * Binary format.
+ *
+ * A st_trie_header_t followed by the units, which start ST_DICT_ALIGN
+ * bytes after the header so a mapped file can be used in place. The whole
+ * record is padded to ST_DICT_ALIGN.
+ */
+#define ST_TRIE_MAGIC   0x45495254 // "TRIE"
+#define ST_TRIE_VERSION 1
+
+typedef struct _st_trie_header_t_ {
+    uint32_t magic;
+    uint32_t version;
+    int32_t  size;
+    int32_t  label_num;
+
+    char     reserved[48];
+} st_trie_header_t;
+
+#define st_trie_align(sz) (((sz) + ST_DICT_ALIGN - 1) \
+        & ~((size_t)ST_DICT_ALIGN - 1))
+
+int st_trie_save(st_trie_t *trie, FILE *fp)
+{
+    static const char zeros[ST_DICT_ALIGN] = {0};
+    st_trie_header_t header;
+    size_t sz;
+    size_t pad;
+
+    ST_CHECK_PARAM(trie == NULL || fp == NULL, -1);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ST_TRIE_MAGIC;
+    header.version = ST_TRIE_VERSION;
+    header.size = trie->size;
+    header.label_num = trie->label_num;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to write header");
+        return -1;
+    }
+
+    sz = sizeof(st_trie_unit_t) * trie->size;
+    pad = st_trie_align(sz) - sz;
+    if (fwrite(trie->units, sizeof(st_trie_unit_t), trie->size, fp)
+                != trie->size
+            || (pad > 0 && fwrite(zeros, 1, pad, fp) != pad)) {
+        ST_ERROR("Failed to write units");
+        return -1;
+    }
+
+    fflush(fp);
+
+    return 0;
+}
+
+static int st_trie_parse_header(st_trie_t *trie, st_trie_header_t *header)
+{
+    if (header->magic != ST_TRIE_MAGIC) {
+        ST_ERROR("Not a trie file.");
+        return -1;
+    }
+
+    if (header->version != ST_TRIE_VERSION) {
+        ST_ERROR("Unknown trie version[%u].", header->version);
+        return -1;
+    }
+
+    if (header->size <= 0 || header->label_num <= 0) {
+        ST_ERROR("Invalid trie header.");
+        return -1;
+    }
+
+    trie->size = header->size;
+    trie->label_num = header->label_num;
+
+    return 0;
+}
+
+// units index nodes and ids in range, so searches stay in bounds
+static int st_trie_check_units(st_trie_t *trie)
+{
+    int i;
+
+    for (i = 0; i < trie->size; i++) {
+        if (trie->units[i].check >= trie->size
+                || trie->units[i].base <= -trie->label_num - 1
+                || trie->units[i].base > trie->size) {
+            ST_ERROR("Invalid trie unit[%d].", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+st_trie_t* st_trie_load_from_bin(FILE *fp)
+{
+    st_trie_header_t header;
+    st_trie_t *trie = NULL;
+    char pad[ST_DICT_ALIGN];
+    size_t sz;
+    size_t num_pad;
+
+    ST_CHECK_PARAM(fp == NULL, NULL);
+
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        ST_ERROR("Failed to read header");
+        return NULL;
+    }
+
+    trie = st_trie_alloc();
+    if (trie == NULL) {
+        ST_ERROR("Failed to st_trie_alloc.");
+        return NULL;
+    }
+
+    if (st_trie_parse_header(trie, &header) < 0) {
+        ST_ERROR("Failed to st_trie_parse_header.");
+        goto ERR;
+    }
+
+    trie->units = (st_trie_unit_t *)st_malloc(sizeof(st_trie_unit_t)
+            * trie->size);
+    if (trie->units == NULL) {
+        ST_ERROR("Failed to st_malloc units.");
+        goto ERR;
+    }
+
+    sz = sizeof(st_trie_unit_t) * trie->size;
+    num_pad = st_trie_align(sz) - sz;
+    if (fread(trie->units, sizeof(st_trie_unit_t), trie->size, fp)
+                != trie->size
+            || (num_pad > 0 && fread(pad, 1, num_pad, fp) != num_pad)) {
+        ST_ERROR("Failed to read units");
+        goto ERR;
+    }
+
+    if (st_trie_check_units(trie) < 0) {
+        ST_ERROR("Failed to st_trie_check_units.");
+        goto ERR;
+    }
+
+    return trie;
+
+ERR:
+    safe_st_trie_destroy(trie);
+    return NULL;
+}
+
+st_trie_t* st_trie_mmap(const char *file)
+{
+    st_trie_header_t header;
+    st_trie_t *trie = NULL;
+    struct stat st;
+    void *addr;
+    int fd = -1;
+
+    ST_CHECK_PARAM(file == NULL, NULL);
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        ST_ERROR("Failed to open file[%s].", file);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header)) {
+        ST_ERROR("Failed to stat file[%s].", file);
+        goto ERR;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ST_ERROR("Failed to mmap file[%s].", file);
+        goto ERR;
+    }
+    safe_close(fd);
+
+    if ((trie = st_trie_alloc()) == NULL) {
+        ST_ERROR("Failed to st_trie_alloc.");
+        (void)munmap(addr, st.st_size);
+        goto ERR;
+    }
+    trie->map_addr = addr;
+    trie->map_len = st.st_size;
+
+    memcpy(&header, addr, sizeof(header));
+    if (st_trie_parse_header(trie, &header) < 0) {
+        ST_ERROR("Failed to st_trie_parse_header.");
+        goto ERR;
+    }
+
+    if (sizeof(header) + sizeof(st_trie_unit_t) * (size_t)trie->size
+            > (size_t)st.st_size) {
+        ST_ERROR("File too small for units.");
+        goto ERR;
+    }
+    trie->units = (st_trie_unit_t *)((char *)addr + sizeof(header));
+
+    if (st_trie_check_units(trie) < 0) {
+        ST_ERROR("Failed to st_trie_check_units.");
+        goto ERR;
+    }
+
+    return trie;
+
+ERR:
+    safe_close(fd);
+    safe_st_trie_destroy(trie);
+    return NULL;
+}
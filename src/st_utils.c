@@ -29,9 +29,12 @@
 #include <float.h>
 #include <math.h>
 #include <sys/stat.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #include <stutils/st_macro.h>
 #include "st_log.h"
+#include "st_mem.h"
 #include "st_utils.h"
 
 const char* st_version()
@@ -140,6 +143,52 @@ uint32_t MurmurHash2 ( const void * key, int len, uint32_t seed )
   return h;
 }
 
+// 64-bit hash for 64-bit platforms, from the same author.
+uint64_t MurmurHash64A ( const void * key, int len, uint64_t seed )
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+
+  uint64_t h = seed ^ (len * m);
+
+  const uint64_t * data = (const uint64_t *)key;
+  const uint64_t * end = data + (len/8);
+
+  while(data != end)
+  {
+    uint64_t k;
+
+    memcpy(&k, data++, sizeof(k));
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  const unsigned char * data2 = (const unsigned char*)data;
+
+  switch(len & 7)
+  {
+  case 7: h ^= (uint64_t)data2[6] << 48;
+  case 6: h ^= (uint64_t)data2[5] << 40;
+  case 5: h ^= (uint64_t)data2[4] << 32;
+  case 4: h ^= (uint64_t)data2[3] << 24;
+  case 3: h ^= (uint64_t)data2[2] << 16;
+  case 2: h ^= (uint64_t)data2[1] << 8;
+  case 1: h ^= (uint64_t)data2[0];
+          h *= m;
+  };
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
 /* qsort.c from GNU Libc. http://code.metager.de/source/xref/gnu/glibc/stdlib/qsort.c */
 /* Copyright (C) 1991-2015 Free Software Foundation, Inc.
    This file is part of the GNU C Library.
@@ -457,3 +506,35 @@ int st_insert(void *base, size_t cap, size_t sz, size_t *num, size_t *pos,
     }
     return 0;
 }
+
+void st_run_threads(st_thread_func_t func, void *args, size_t arg_size,
+        int nthreads)
+{
+    pthread_t *tids;
+    bool *started;
+    int t;
+
+    tids = (pthread_t *)st_malloc(sizeof(pthread_t) * nthreads);
+    started = (bool *)st_malloc(sizeof(bool) * nthreads);
+    for (t = 0; t < nthreads; t++) {
+        if (tids == NULL || started == NULL
+                || pthread_create(tids + t, NULL, func,
+                    (char *)args + arg_size * t) != 0) {
+            (void)func((char *)args + arg_size * t);
+            if (started != NULL) {
+                started[t] = false;
+            }
+            continue;
+        }
+        started[t] = true;
+    }
+
+    for (t = 0; t < nthreads && tids != NULL && started != NULL; t++) {
+        if (started[t]) {
+            (void)pthread_join(tids[t], NULL);
+        }
+    }
+
+    safe_st_free(tids);
+    safe_st_free(started);
+}
@@ -43,6 +43,7 @@ void split_long(long l, unsigned int *a, unsigned int *b);
 unsigned int highest_bit_mask(unsigned int num, int overflow);
 
 uint32_t MurmurHash2 ( const void * key, int len, uint32_t seed );
+uint64_t MurmurHash64A ( const void * key, int len, uint64_t seed );
 
 int st_permutation(void *base, size_t n, size_t sz,
         int (*callback)(void *base, size_t n, void *args), void *args);
@@ -87,6 +88,26 @@ typedef st_cmp_ret_t (*st_cmp_func_t) (const void *elem1, const void *elem2,
 int st_insert(void *base, size_t cap, size_t sz, size_t *num, size_t *pos,
         void *elem, st_cmp_func_t cmp, void *arg);
 
+/*
+ * thread function
+ *
+ * @param[in] arg arg of the thread.
+ * @return ignored.
+ */
+typedef void* (*st_thread_func_t)(void *arg);
+
+/*
+ * Run func on nthreads args and wait for all of them. If a thread can not
+ * be created, its share is done by the calling thread.
+ *
+ * @param[in] func the thread function.
+ * @param[in] args array of nthreads args.
+ * @param[in] arg_size size of one arg.
+ * @param[in] nthreads number of threads.
+ */
+void st_run_threads(st_thread_func_t func, void *args, size_t arg_size,
+        int nthreads);
+
 #ifdef __cplusplus
 }
 #endif
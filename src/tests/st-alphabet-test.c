@@ -0,0 +1,946 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "st_io.h"
+#include "st_alphabet.h"
+
+#define N 20000
+
+static void make_label(char *buf, size_t len, int i)
+{
+    // lengths vary from a few bytes to a few dozens, so chunks fill unevenly
+    snprintf(buf, len, "w%d-%.*s", i, i % 40,
+            "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+}
+
+static int check_alphabet(st_alphabet_t *alphabet, int n)
+{
+    char buf[MAX_SYM_LEN];
+    char *label;
+    int i;
+
+    if (st_alphabet_get_label_num(alphabet) != n) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        make_label(buf, sizeof(buf), i);
+        if (st_alphabet_get_index(alphabet, buf) != i) {
+            return -1;
+        }
+        label = st_alphabet_get_label(alphabet, i);
+        if (label == NULL || strcmp(label, buf) != 0) {
+            return -1;
+        }
+    }
+
+    make_label(buf, sizeof(buf), n);
+    if (st_alphabet_get_index(alphabet, buf) >= 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unit_test_alphabet()
+{
+    char buf[2 * MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    st_alphabet_t *loaded = NULL;
+    char *first;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int i;
+
+    fprintf(stderr, "  Testing st_alphabet...\n");
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // grows from the default capacity
+    alphabet = st_alphabet_create(0);
+    assert(alphabet != NULL);
+    first = NULL;
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        if (st_alphabet_add_label(alphabet, buf) != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        if (i == 0) {
+            first = st_alphabet_get_label(alphabet, 0);
+        }
+    }
+    make_label(buf, sizeof(buf), 7);
+    if (st_alphabet_add_label(alphabet, buf) != 7
+            || alphabet->chunk_num < 2
+            || first != st_alphabet_get_label(alphabet, 0)
+            || check_alphabet(alphabet, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // labels are truncated to MAX_SYM_LEN - 1 bytes
+    memset(buf, 'x', sizeof(buf));
+    buf[sizeof(buf) - 1] = 0;
+    if (st_alphabet_add_label(alphabet, buf) != N
+            || strlen(st_alphabet_get_label(alphabet, N)) != MAX_SYM_LEN - 1
+            || st_alphabet_add_label(alphabet, "grown") != N + 1) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(alphabet);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    fp = tmpfile();
+    assert(fp != NULL);
+    if (st_alphabet_save_bin(alphabet, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    loaded = st_alphabet_load_from_bin(fp);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0
+            || st_alphabet_add_label(loaded, "grown") != N
+            || st_alphabet_get_index(loaded, "grown") != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_fclose(fp);
+    safe_st_alphabet_destroy(loaded);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    fp = tmpfile();
+    assert(fp != NULL);
+    if (st_alphabet_save_txt(alphabet, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    loaded = st_alphabet_load_from_txt(fp, N);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_fclose(fp);
+    safe_st_alphabet_destroy(loaded);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    loaded = st_alphabet_dup(alphabet);
+    safe_st_alphabet_destroy(alphabet);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(loaded);
+    fprintf(stderr, "Success\n");
+
+    return 0;
+
+ERR:
+    safe_st_fclose(fp);
+    safe_st_alphabet_destroy(alphabet);
+    safe_st_alphabet_destroy(loaded);
+    return -1;
+}
+
+static int unit_test_alphabet_bin()
+{
+    char fname[] = "/tmp/st-alphabet-test.XXXXXX";
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    st_alphabet_t *loaded = NULL;
+    st_alphabet_t *dup = NULL;
+    st_label_t rec;
+    uint64_t off;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int fd;
+    int i;
+
+    fprintf(stderr, "  Testing st_alphabet bin...\n");
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    fd = mkstemp(fname);
+    assert(fd >= 0);
+    fp = fdopen(fd, "w+");
+    assert(fp != NULL);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_alphabet_save_bin(alphabet, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fflush(fp);
+    loaded = st_alphabet_mmap(fname);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    make_label(buf, sizeof(buf), N);
+    if (st_alphabet_add_label(loaded, buf) >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    dup = st_alphabet_dup(loaded);
+    safe_st_alphabet_destroy(loaded);
+    if (dup == NULL || check_alphabet(dup, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(dup);
+
+    // an offset out of the arena is rejected like the loader does
+    off = alphabet->label_offs[N - 1];
+    alphabet->label_offs[N - 1] = alphabet->pool_size + 100;
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 0) == 0);
+    if (st_alphabet_save_bin(alphabet, fp) < 0 || fflush(fp) != 0
+            || (loaded = st_alphabet_mmap(fname)) != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    alphabet->label_offs[N - 1] = off;
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // file written by old versions
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 0) == 0);
+    i = N;
+    assert(fwrite(&i, sizeof(int), 1, fp) == 1);
+    for (i = 0; i < N; i++) {
+        memset(&rec, 0, sizeof(rec));
+        make_label(rec.label, sizeof(rec.label), i);
+        rec.symid = i;
+        assert(fwrite(&rec, sizeof(rec), 1, fp) == 1);
+    }
+    rewind(fp);
+    loaded = st_alphabet_load_from_bin(fp);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(loaded);
+    fflush(fp);
+    loaded = st_alphabet_mmap(fname);
+    if (loaded != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_alphabet_destroy(alphabet);
+    safe_st_alphabet_destroy(loaded);
+    safe_st_alphabet_destroy(dup);
+    return -1;
+}
+
+static int unit_test_alphabet_freeze()
+{
+    char fname[] = "/tmp/st-alphabet-test.XXXXXX";
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    st_alphabet_t *loaded = NULL;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int fd;
+    int i;
+
+    fprintf(stderr, "  Testing st_alphabet freeze...\n");
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = 1; i <= 100; i++) {
+        alphabet = st_alphabet_create(i);
+        assert(alphabet != NULL);
+        for (fd = 0; fd < i; fd++) {
+            make_label(buf, sizeof(buf), fd);
+            assert(st_alphabet_add_label(alphabet, buf) == fd);
+        }
+        if (st_alphabet_freeze(alphabet) < 0
+                || alphabet->index_dict != NULL
+                || check_alphabet(alphabet, i) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        safe_st_alphabet_destroy(alphabet);
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    if (st_alphabet_freeze(alphabet) < 0 || check_alphabet(alphabet, N) < 0
+            || st_alphabet_add_label(alphabet, "new") >= 0
+            || st_alphabet_get_index(alphabet, "") >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    loaded = st_alphabet_dup(alphabet);
+    if (loaded == NULL || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(loaded);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    fd = mkstemp(fname);
+    assert(fd >= 0);
+    fp = fdopen(fd, "w+");
+    assert(fp != NULL);
+    if (st_alphabet_save_bin(alphabet, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    loaded = st_alphabet_load_from_bin(fp);
+    if (loaded == NULL || loaded->mph == NULL
+            || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(loaded);
+    loaded = st_alphabet_mmap(fname);
+    if (loaded == NULL || loaded->mph == NULL
+            || check_alphabet(loaded, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(loaded);
+
+    // an id out of range is rejected by both the loader and the mapping
+    i = alphabet->mph->ids[0];
+    alphabet->mph->ids[0] = N;
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 0) == 0);
+    if (st_alphabet_save_bin(alphabet, fp) < 0 || fflush(fp) != 0
+            || (loaded = st_alphabet_mmap(fname)) != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    if ((loaded = st_alphabet_load_from_bin(fp)) != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    alphabet->mph->ids[0] = i;
+    fprintf(stderr, "Success\n");
+
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_alphabet_destroy(alphabet);
+    safe_st_alphabet_destroy(loaded);
+    return -1;
+}
+
+static int write_txt(const char *fname, int n, bool tail_newline)
+{
+    char buf[MAX_SYM_LEN];
+    FILE *fp;
+    int i;
+
+    fp = fopen(fname, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+    // ids in reverse order, separated by blanks and tabs
+    for (i = n - 1; i >= 0; i--) {
+        make_label(buf, sizeof(buf), i);
+        fprintf(fp, "%s%s%d%s", buf, (i % 2 == 0) ? "\t" : " \t ", i,
+                (i > 0 || tail_newline) ? "\n" : "");
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+static int unit_test_alphabet_txt()
+{
+    char fname[] = "/tmp/st-alphabet-test.XXXXXX";
+    st_alphabet_t *alphabet = NULL;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int fd;
+    int t;
+
+    fprintf(stderr, "  Testing st_alphabet txt...\n");
+    fd = mkstemp(fname);
+    assert(fd >= 0);
+    close(fd);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    assert(write_txt(fname, N, true) == 0);
+    alphabet = st_alphabet_load_from_txt_file(fname);
+    if (alphabet == NULL || check_alphabet(alphabet, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(alphabet);
+    for (t = 1; t <= 8; t *= 2) {
+        alphabet = st_alphabet_load_from_txt_parallel(fname, t);
+        if (alphabet == NULL || check_alphabet(alphabet, N) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        safe_st_alphabet_destroy(alphabet);
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    assert(write_txt(fname, 3, false) == 0);
+    alphabet = st_alphabet_load_from_txt_parallel(fname, 8);
+    if (alphabet == NULL || check_alphabet(alphabet, 3) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(alphabet);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    fp = fopen(fname, "w");
+    assert(fp != NULL);
+    fprintf(fp, "a\t0\nb\t0\n");
+    safe_st_fclose(fp);
+    alphabet = st_alphabet_load_from_txt_parallel(fname, 2);
+    if (alphabet != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fp = fopen(fname, "w");
+    assert(fp != NULL);
+    fprintf(fp, "a\t0\nb c\t1\n");
+    safe_st_fclose(fp);
+    alphabet = st_alphabet_load_from_txt_parallel(fname, 2);
+    if (alphabet != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fp = fopen(fname, "w");
+    assert(fp != NULL);
+    fprintf(fp, "a 0\nb 1\na 2\nc 3\n");
+    safe_st_fclose(fp);
+    alphabet = st_alphabet_load_from_txt_parallel(fname, 2);
+    if (alphabet != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fp = fopen(fname, "w");
+    assert(fp != NULL);
+    fprintf(fp, "a\t0\r\nb\t1\r\n");
+    safe_st_fclose(fp);
+    alphabet = st_alphabet_load_from_txt_parallel(fname, 2);
+    if (alphabet == NULL || st_alphabet_get_index(alphabet, "b") != 1) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_alphabet_destroy(alphabet);
+    fprintf(stderr, "Success\n");
+
+    unlink(fname);
+    return 0;
+
+ERR:
+    unlink(fname);
+    safe_st_alphabet_destroy(alphabet);
+    return -1;
+}
+
+static int check_batch(st_alphabet_t *alphabet)
+{
+    char line[200 * 64];
+    char buf[MAX_SYM_LEN];
+    int indices[200];
+    int n;
+    int i;
+
+    // 150 tokens, every 5th one unknown, mixed blanks
+    line[0] = 0;
+    for (i = 0; i < 150; i++) {
+        make_label(buf, sizeof(buf), (i % 5 == 0) ? N + i : i * 97 % N);
+        strcat(line, (i % 3 == 0) ? " \t" : " ");
+        strcat(line, buf);
+    }
+    strcat(line, "\n");
+
+    n = st_alphabet_get_index_batch(alphabet, line, NULL, indices, 200);
+    if (n != 150) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if (indices[i] != ((i % 5 == 0) ? -1 : i * 97 % N)) {
+            return -1;
+        }
+    }
+
+    if (st_alphabet_get_index_batch(alphabet, line, NULL, indices, 149) >= 0) {
+        return -1;
+    }
+
+    if (st_alphabet_get_index_batch(alphabet, "w1-a|w2-ab||w3", "|",
+                indices, 200) != 3 || indices[0] != 1 || indices[1] != 2
+            || indices[2] != -1) {
+        return -1;
+    }
+
+    if (st_alphabet_get_index_batch(alphabet, "  \n", NULL,
+                indices, 200) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unit_test_alphabet_batch()
+{
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    int ncase = 1;
+    int i;
+
+    fprintf(stderr, "  Testing st_alphabet batch...\n");
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (check_batch(alphabet) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_alphabet_freeze(alphabet) < 0 || check_batch(alphabet) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    safe_st_alphabet_destroy(alphabet);
+    return -1;
+}
+
+#define NUM_THREADS 4
+
+typedef struct _add_args_t_ {
+    st_alphabet_t *alphabet;
+    int tid;
+    int *ids; /* id of every label as seen by this thread. */
+    int ret;
+} add_args_t;
+
+static void* add_thread(void *args)
+{
+    add_args_t *aa = (add_args_t *)args;
+    // strides coprime to N, so that every thread adds every label
+    static const int64_t strides[NUM_THREADS] = {1, 3, 7, 11};
+    char buf[MAX_SYM_LEN];
+    int i, k;
+
+    aa->ret = 0;
+    for (k = 0; k < N; k++) {
+        i = (int)((k * strides[aa->tid] + aa->tid * 997) % N);
+        make_label(buf, sizeof(buf), i);
+        aa->ids[i] = st_alphabet_add_label(aa->alphabet, buf);
+        if (aa->ids[i] < 0 || aa->ids[i] >= N) {
+            aa->ret = -1;
+            break;
+        }
+        if (st_alphabet_get_label(aa->alphabet, aa->ids[i]) == NULL
+                || strcmp(st_alphabet_get_label(aa->alphabet, aa->ids[i]),
+                    buf) != 0) {
+            aa->ret = -1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int unit_test_alphabet_concurrent()
+{
+    char buf[MAX_SYM_LEN];
+    add_args_t args[NUM_THREADS];
+    pthread_t pts[NUM_THREADS];
+    st_alphabet_opt_t opt;
+    st_alphabet_t *alphabet = NULL;
+    int ncase = 1;
+    int i, t;
+
+    fprintf(stderr, "  Testing st_alphabet concurrent...\n");
+    opt.concurrent = true;
+    alphabet = st_alphabet_create_ex(N, &opt);
+    assert(alphabet != NULL);
+    for (t = 0; t < NUM_THREADS; t++) {
+        args[t].ids = (int *)malloc(sizeof(int) * N);
+        assert(args[t].ids != NULL);
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (t = 0; t < NUM_THREADS; t++) {
+        args[t].alphabet = alphabet;
+        args[t].tid = t;
+        assert(pthread_create(pts + t, NULL, add_thread, args + t) == 0);
+    }
+    for (t = 0; t < NUM_THREADS; t++) {
+        assert(pthread_join(pts[t], NULL) == 0);
+        if (args[t].ret < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    // max_label_num is a hard limit in concurrent mode
+    if (st_alphabet_get_label_num(alphabet) != N
+            || st_alphabet_add_label(alphabet, "overflow") >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        for (t = 0; t < NUM_THREADS; t++) {
+            if (args[t].ids[i] != args[0].ids[i]) {
+                break;
+            }
+        }
+        if (t < NUM_THREADS
+                || st_alphabet_get_index(alphabet, buf) != args[0].ids[i]) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_alphabet_freeze(alphabet) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        if (st_alphabet_get_index(alphabet, buf) != args[0].ids[i]) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        safe_free(args[t].ids);
+    }
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    for (t = 0; t < NUM_THREADS; t++) {
+        safe_free(args[t].ids);
+    }
+    safe_st_alphabet_destroy(alphabet);
+    return -1;
+}
+
+#define NUM_SHARDS 3
+
+static int unit_test_alphabet_merge()
+{
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *shards[NUM_SHARDS] = {NULL};
+    int *remaps[NUM_SHARDS] = {NULL};
+    st_alphabet_t *merged = NULL;
+    char *label;
+    int ncase = 1;
+    int i, k, n;
+
+    fprintf(stderr, "  Testing st_alphabet merge...\n");
+    // shard k holds labels [k * N / 4, k * N / 4 + N / 2) in reverse
+    n = N / 2;
+    for (k = 0; k < NUM_SHARDS; k++) {
+        shards[k] = st_alphabet_create(n);
+        assert(shards[k] != NULL);
+        for (i = 0; i < n; i++) {
+            make_label(buf, sizeof(buf), k * N / 4 + n - 1 - i);
+            assert(st_alphabet_add_label(shards[k], buf) == i);
+        }
+        remaps[k] = (int *)malloc(sizeof(int) * n);
+        assert(remaps[k] != NULL);
+    }
+    assert(st_alphabet_freeze(shards[NUM_SHARDS - 1]) == 0);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    merged = st_alphabet_merge(shards, NUM_SHARDS, remaps, 3);
+    if (merged == NULL || st_alphabet_get_label_num(merged)
+            != (NUM_SHARDS - 1) * N / 4 + n) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (k = 0; k < NUM_SHARDS; k++) {
+        for (i = 0; i < n; i++) {
+            label = st_alphabet_get_label(merged, remaps[k][i]);
+            if ((k == 0 && remaps[k][i] != i) || label == NULL
+                    || strcmp(label, st_alphabet_get_label(shards[k], i)) != 0
+                    || st_alphabet_get_index(merged, label) != remaps[k][i]) {
+                fprintf(stderr, "Failed\n");
+                goto ERR;
+            }
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    safe_st_alphabet_destroy(merged);
+    merged = st_alphabet_merge(shards, 1, NULL, 1);
+    if (merged == NULL || st_alphabet_get_label_num(merged) != n
+            || st_alphabet_add_label(merged, "grown") != n) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    for (k = 0; k < NUM_SHARDS; k++) {
+        safe_st_alphabet_destroy(shards[k]);
+        safe_free(remaps[k]);
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // empty shards give an empty alphabet
+    safe_st_alphabet_destroy(merged);
+    for (k = 0; k < NUM_SHARDS; k++) {
+        shards[k] = st_alphabet_create(16);
+        assert(shards[k] != NULL);
+    }
+    merged = st_alphabet_merge(shards, NUM_SHARDS, NULL, 3);
+    if (merged == NULL || st_alphabet_get_label_num(merged) != 0
+            || st_alphabet_add_label(merged, "grown") != 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    for (k = 0; k < NUM_SHARDS; k++) {
+        safe_st_alphabet_destroy(shards[k]);
+    }
+    safe_st_alphabet_destroy(merged);
+    return 0;
+
+ERR:
+    for (k = 0; k < NUM_SHARDS; k++) {
+        safe_st_alphabet_destroy(shards[k]);
+        safe_free(remaps[k]);
+    }
+    safe_st_alphabet_destroy(merged);
+    return -1;
+}
+
+static int unit_test_alphabet_relayout()
+{
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    uint64_t *freqs = NULL;
+    int *new_ids = NULL;
+    int *old_ids = NULL;
+    char *label;
+    int ncase = 1;
+    int i;
+
+    fprintf(stderr, "  Testing st_alphabet relayout...\n");
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    freqs = (uint64_t *)malloc(sizeof(uint64_t) * N);
+    new_ids = (int *)malloc(sizeof(int) * N);
+    old_ids = (int *)malloc(sizeof(int) * N);
+    assert(freqs != NULL && new_ids != NULL && old_ids != NULL);
+    for (i = 0; i < N; i++) {
+        make_label(buf, sizeof(buf), i);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+        freqs[i] = (uint64_t)(i * 7919 % 97);
+        old_ids[i] = -1;
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_alphabet_relayout(alphabet, freqs, new_ids) < 0
+            || st_alphabet_get_label_num(alphabet) != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < N; i++) {
+        if (new_ids[i] < 0 || new_ids[i] >= N || old_ids[new_ids[i]] >= 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        old_ids[new_ids[i]] = i;
+    }
+    for (i = 0; i < N; i++) {
+        // by descending frequency, ties in the previous order
+        if (i > 0 && (freqs[old_ids[i - 1]] < freqs[old_ids[i]]
+                    || (freqs[old_ids[i - 1]] == freqs[old_ids[i]]
+                        && old_ids[i - 1] > old_ids[i]))) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        make_label(buf, sizeof(buf), old_ids[i]);
+        label = st_alphabet_get_label(alphabet, i);
+        if (label == NULL || strcmp(label, buf) != 0
+                || st_alphabet_get_index(alphabet, buf) != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_alphabet_add_label(alphabet, "grown") != N
+            || st_alphabet_freeze(alphabet) < 0
+            || st_alphabet_get_index(alphabet, "grown") != N
+            || st_alphabet_relayout(alphabet, freqs, NULL) >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_free(freqs);
+    safe_free(new_ids);
+    safe_free(old_ids);
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    safe_free(freqs);
+    safe_free(new_ids);
+    safe_free(old_ids);
+    safe_st_alphabet_destroy(alphabet);
+    return -1;
+}
+
+static int run_all_tests()
+{
+    int ret = 0;
+
+    if (unit_test_alphabet() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_bin() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_freeze() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_txt() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_batch() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_concurrent() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_merge() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_alphabet_relayout() != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret;
+
+    fprintf(stderr, "Start testing...\n");
+    ret = run_all_tests();
+    if (ret != 0) {
+        fprintf(stderr, "Tests failed.\n");
+    } else {
+        fprintf(stderr, "Tests succeeded.\n");
+    }
+
+    return ret;
+}
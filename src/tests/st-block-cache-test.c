@@ -23,11 +23,14 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "st_block_cache.h"
 
 #define N 5
+#define NUM_SMALL_BLOCKS (4 * 256 * 256 + 4)
 static int unit_test_block_cache()
 {
     st_block_cache_t *bcache = NULL;
@@ -116,6 +119,544 @@ static int unit_test_block_cache()
         goto ERR;
     }
     fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // small pools grow past 256 leaves of the directory
+    bcache = st_block_cache_create(sizeof(int), 4);
+    assert(bcache != NULL);
+    for (i = 0; i < NUM_SMALL_BLOCKS; i++) {
+        bid = -1;
+        data = st_block_cache_fetch(bcache, &bid);
+        if (data == NULL) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        *data = bid;
+    }
+    data = st_block_cache_read(bcache, bid);
+    if (data == NULL || *data != bid
+            || st_block_cache_size(bcache) != NUM_SMALL_BLOCKS) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_block_cache_destroy(bcache);
+    return 0;
+
+ERR:
+    safe_st_block_cache_destroy(bcache);
+    return -1;
+}
+
+#define NUM_THREADS 4
+#define NUM_HELD    100
+#define NUM_ROUNDS  200
+
+typedef struct _bcache_args_t_ {
+    st_block_cache_t *bcache;
+    int tid;
+    int ret;
+} bcache_args_t;
+
+static void* bcache_thread(void *args)
+{
+    bcache_args_t *ba = (bcache_args_t *)args;
+    bcache_id_t bids[NUM_HELD];
+    int *data;
+    int r, i;
+
+    ba->ret = 0;
+    for (r = 0; r < NUM_ROUNDS; r++) {
+        for (i = 0; i < NUM_HELD; i++) {
+            bids[i] = -1;
+            data = st_block_cache_fetch(ba->bcache, bids + i);
+            if (data == NULL) {
+                ba->ret = -1;
+                return NULL;
+            }
+            *data = ba->tid * NUM_HELD + i;
+        }
+        // a block handed to two threads would be overwritten
+        for (i = 0; i < NUM_HELD; i++) {
+            data = st_block_cache_read(ba->bcache, bids[i]);
+            if (data == NULL || *data != ba->tid * NUM_HELD + i
+                    || st_block_cache_return(ba->bcache, bids[i]) < 0) {
+                ba->ret = -1;
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+#define NUM_READS 100000
+#define NUM_GROWS 2000
+
+typedef struct _read_args_t_ {
+    st_block_cache_t *bcache;
+    bcache_id_t bid;
+    int ret;
+} read_args_t;
+
+static void* read_thread(void *args)
+{
+    read_args_t *ra = (read_args_t *)args;
+    int *data;
+    int i;
+
+    ra->ret = 0;
+    for (i = 0; i < NUM_READS; i++) {
+        data = st_block_cache_read(ra->bcache, ra->bid);
+        if (data == NULL || *data != 42) {
+            ra->ret = -1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// fetch and return from NUM_THREADS threads, all blocks free at the end
+static int run_threads(st_block_cache_t *bcache)
+{
+    bcache_args_t args[NUM_THREADS];
+    pthread_t pts[NUM_THREADS];
+    int ret = 0;
+    int t;
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        args[t].bcache = bcache;
+        args[t].tid = t;
+        assert(pthread_create(pts + t, NULL, bcache_thread, args + t) == 0);
+    }
+    for (t = 0; t < NUM_THREADS; t++) {
+        assert(pthread_join(pts[t], NULL) == 0);
+        if (args[t].ret < 0) {
+            ret = -1;
+        }
+    }
+    if (st_block_cache_size(bcache) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int unit_test_block_cache_threads()
+{
+    st_block_cache_t *bcache = NULL;
+    st_block_cache_opt_t opt;
+    read_args_t rargs[NUM_THREADS];
+    pthread_t pts[NUM_THREADS];
+    bcache_id_t bid;
+    int ncase = 1;
+    int *data;
+    int i, t;
+
+    fprintf(stderr, "  Testing st_block_cache threads...\n");
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    bcache = st_block_cache_create(sizeof(int), 64);
+    assert(bcache != NULL);
+    if (run_threads(bcache) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // mapped pools, huge pages and NUMA binding are best effort
+    memset(&opt, 0, sizeof(opt));
+    opt.huge_pages = true;
+    opt.numa = true;
+    // every pool fills one huge page
+    bcache = st_block_cache_create_ex(ST_BCACHE_HUGE_PAGE_SIZE / 64, 64, &opt);
+    if (bcache == NULL || !bcache->mmap_pools || run_threads(bcache) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // unkeyed blocks of a keyed cache go back to the free blocks
+    memset(&opt, 0, sizeof(opt));
+    opt.keyed = true;
+    bcache = st_block_cache_create_ex(sizeof(int), 64, &opt);
+    if (bcache == NULL || run_threads(bcache) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // readers run while the directory grows by hundreds of pools
+    bcache = st_block_cache_create(sizeof(int), 4);
+    assert(bcache != NULL);
+    rargs[0].bid = -1;
+    data = st_block_cache_fetch(bcache, &rargs[0].bid);
+    assert(data != NULL);
+    *data = 42;
+    for (t = 0; t < NUM_THREADS - 1; t++) {
+        rargs[t].bcache = bcache;
+        rargs[t].bid = rargs[0].bid;
+        assert(pthread_create(pts + t, NULL, read_thread, rargs + t) == 0);
+    }
+    for (i = 0; i < NUM_GROWS; i++) {
+        bid = -1;
+        assert(st_block_cache_fetch(bcache, &bid) != NULL);
+    }
+    for (t = 0; t < NUM_THREADS - 1; t++) {
+        assert(pthread_join(pts[t], NULL) == 0);
+        if (rargs[t].ret < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (st_block_cache_size(bcache) != NUM_GROWS + 1
+            || st_block_cache_capacity(bcache) < NUM_GROWS + 1) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_block_cache_destroy(bcache);
+    return 0;
+
+ERR:
+    safe_st_block_cache_destroy(bcache);
+    return -1;
+}
+
+typedef struct _idle_args_t_ {
+    st_block_cache_t *bcache;
+    pthread_barrier_t *barrier;
+    int ret;
+} idle_args_t;
+
+// fetch and return one block, then stay alive till the barrier
+static void* idle_thread(void *args)
+{
+    idle_args_t *ia = (idle_args_t *)args;
+    bcache_id_t bid = -1;
+
+    ia->ret = 0;
+    if (st_block_cache_fetch(ia->bcache, &bid) == NULL
+            || st_block_cache_return(ia->bcache, bid) < 0) {
+        ia->ret = -1;
+    }
+    (void)pthread_barrier_wait(ia->barrier);
+    (void)pthread_barrier_wait(ia->barrier);
+
+    return NULL;
+}
+
+static int unit_test_block_cache_keyed()
+{
+    static const int resident[8] = {3, 5, 6, 7, 8, 9, 10, 11};
+    st_block_cache_t *bcache = NULL;
+    st_block_cache_opt_t opt;
+    pthread_barrier_t barrier;
+    idle_args_t iargs;
+    bcache_id_t bids[8];
+    bcache_id_t bid;
+    pthread_t pt;
+    bool found;
+    int ncase = 1;
+    int *data;
+    int i;
+
+    fprintf(stderr, "  Testing st_block_cache keyed...\n");
+    memset(&opt, 0, sizeof(opt));
+    opt.keyed = true;
+    opt.max_blocks = 8;
+    bcache = st_block_cache_create_ex(sizeof(int), 4, &opt);
+    assert(bcache != NULL);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = 1; i <= 8; i++) {
+        data = st_block_cache_fetch_key(bcache, i, &bid, &found);
+        if (data == NULL || found) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        *data = i;
+        assert(st_block_cache_return(bcache, bid) == 0);
+    }
+    // unreferenced blocks stay resident
+    data = st_block_cache_fetch_key(bcache, 3, &bid, &found);
+    if (data == NULL || !found || *data != 3
+            || st_block_cache_size(bcache) != 8
+            || st_block_cache_return(bcache, bid) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // the first sweep clears every clock bit and evicts key 1
+    data = st_block_cache_fetch_key(bcache, 9, &bid, &found);
+    assert(data != NULL && !found);
+    *data = 9;
+    assert(st_block_cache_return(bcache, bid) == 0);
+    // key 3 is used again, so keys 2 and 4 go before it
+    data = st_block_cache_fetch_key(bcache, 3, &bid, &found);
+    assert(data != NULL && found);
+    assert(st_block_cache_return(bcache, bid) == 0);
+    for (i = 10; i <= 11; i++) {
+        data = st_block_cache_fetch_key(bcache, i, &bid, &found);
+        assert(data != NULL && !found);
+        *data = i;
+        assert(st_block_cache_return(bcache, bid) == 0);
+    }
+    if (st_block_cache_capacity(bcache) != 8) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    // hits do not evict, so look at the resident keys first
+    for (i = 0; i < 8; i++) {
+        data = st_block_cache_fetch_key(bcache, resident[i], bids, &found);
+        if (data == NULL || !found || *data != resident[i]) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        assert(st_block_cache_return(bcache, bids[0]) == 0);
+    }
+    data = st_block_cache_fetch_key(bcache, 4, bids, &found);
+    if (data == NULL || found) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    assert(st_block_cache_return(bcache, bids[0]) == 0);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // nothing can be evicted while every block is referenced
+    for (i = 0; i < 8; i++) {
+        if (st_block_cache_fetch_key(bcache, 100 + i, bids + i, NULL)
+                == NULL) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (st_block_cache_fetch_key(bcache, 200, &bid, NULL) != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < 8; i++) {
+        assert(st_block_cache_return(bcache, bids[i]) == 0);
+    }
+    if (st_block_cache_fetch_key(bcache, 200, &bid, &found) == NULL
+            || found || st_block_cache_return(bcache, bid) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_block_cache_clear(bcache) < 0 || st_block_cache_size(bcache) != 0
+            || st_block_cache_fetch_key(bcache, 200, &bid, &found) == NULL
+            || found) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // free blocks taken by another live thread can still be used
+    assert(st_block_cache_return(bcache, bid) == 0);
+    assert(pthread_barrier_init(&barrier, NULL, 2) == 0);
+    iargs.bcache = bcache;
+    iargs.barrier = &barrier;
+    assert(pthread_create(&pt, NULL, idle_thread, &iargs) == 0);
+    (void)pthread_barrier_wait(&barrier);
+    for (i = 0; i < 8; i++) {
+        if (st_block_cache_fetch_key(bcache, 300 + i, bids + i, NULL)
+                == NULL) {
+            break;
+        }
+    }
+    (void)pthread_barrier_wait(&barrier);
+    assert(pthread_join(pt, NULL) == 0);
+    (void)pthread_barrier_destroy(&barrier);
+    if (iargs.ret < 0 || i < 8) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < 8; i++) {
+        assert(st_block_cache_return(bcache, bids[i]) == 0);
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_block_cache_destroy(bcache);
+    return 0;
+
+ERR:
+    safe_st_block_cache_destroy(bcache);
+    return -1;
+}
+
+#define NUM_TRIM_BLOCKS 4096
+#define NUM_TRIM_HELD   64
+#define NUM_TRIM_ROUNDS 1000
+static int check_trim(st_block_cache_t *bcache, int num_blocks)
+{
+    bcache_id_t bids[NUM_TRIM_BLOCKS];
+    int num_pools;
+    int *data;
+    int i;
+
+    for (i = 0; i < num_blocks; i++) {
+        bids[i] = -1;
+        data = st_block_cache_fetch(bcache, bids + i);
+        if (data == NULL) {
+            return -1;
+        }
+        *data = i;
+    }
+    for (i = 0; i < num_blocks; i++) {
+        if (st_block_cache_return(bcache, bids[i]) < 0) {
+            return -1;
+        }
+    }
+    num_pools = st_block_cache_capacity(bcache) / bcache->count;
+    if (st_block_cache_trim(bcache) != num_pools
+            || st_block_cache_trim(bcache) != 0) {
+        return -1;
+    }
+
+    // trimmed pools come back on fetch, one held block keeps its pool
+    for (i = 0; i < num_blocks; i++) {
+        bids[i] = -1;
+        data = st_block_cache_fetch(bcache, bids + i);
+        if (data == NULL) {
+            return -1;
+        }
+        *data = i;
+    }
+    for (i = 1; i < num_blocks; i++) {
+        data = st_block_cache_fetch(bcache, bids + i);
+        if (data == NULL || *data != i) {
+            return -1;
+        }
+        (void)st_block_cache_return(bcache, bids[i]);
+        (void)st_block_cache_return(bcache, bids[i]);
+    }
+    if (st_block_cache_size(bcache) != 1
+            || st_block_cache_trim(bcache) != num_pools - 1) {
+        return -1;
+    }
+    data = st_block_cache_fetch(bcache, bids);
+    if (data == NULL || *data != 0) {
+        return -1;
+    }
+    (void)st_block_cache_return(bcache, bids[0]);
+    (void)st_block_cache_return(bcache, bids[0]);
+
+    return 0;
+}
+
+// fetch a held block by id again and again
+static void* fetch_thread(void *args)
+{
+    read_args_t *ra = (read_args_t *)args;
+    bcache_id_t bid;
+    int *data;
+    int i;
+
+    ra->ret = 0;
+    for (i = 0; i < NUM_TRIM_ROUNDS * 10; i++) {
+        bid = ra->bid;
+        data = st_block_cache_fetch(ra->bcache, &bid);
+        if (data == NULL || *data != 42
+                || st_block_cache_return(ra->bcache, bid) < 0) {
+            ra->ret = -1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int unit_test_block_cache_trim()
+{
+    st_block_cache_t *bcache = NULL;
+    st_block_cache_opt_t opt;
+    bcache_id_t bids[NUM_TRIM_HELD];
+    read_args_t rargs;
+    pthread_t pt;
+    int ncase = 1;
+    int *data;
+    int r, i;
+
+    fprintf(stderr, "  Testing st_block_cache trim...\n");
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    bcache = st_block_cache_create(sizeof(int), 4);
+    assert(bcache != NULL);
+    if (check_trim(bcache, NUM_TRIM_BLOCKS) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // mapped pools stay mapped, only their pages are given back
+    memset(&opt, 0, sizeof(opt));
+    opt.huge_pages = true;
+    bcache = st_block_cache_create_ex(ST_BCACHE_HUGE_PAGE_SIZE / 1024, 1024,
+            &opt);
+    if (bcache == NULL || check_trim(bcache, NUM_TRIM_BLOCKS) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+    safe_st_block_cache_destroy(bcache);
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // pools are trimmed and refilled while a held block is fetched by id
+    bcache = st_block_cache_create(sizeof(int), 4);
+    assert(bcache != NULL);
+    rargs.bcache = bcache;
+    rargs.bid = -1;
+    data = st_block_cache_fetch(bcache, &rargs.bid);
+    assert(data != NULL);
+    *data = 42;
+    assert(pthread_create(&pt, NULL, fetch_thread, &rargs) == 0);
+    for (r = 0; r < NUM_TRIM_ROUNDS; r++) {
+        for (i = 0; i < NUM_TRIM_HELD; i++) {
+            bids[i] = -1;
+            data = st_block_cache_fetch(bcache, bids + i);
+            assert(data != NULL);
+            *data = i;
+        }
+        for (i = 0; i < NUM_TRIM_HELD; i++) {
+            assert(st_block_cache_return(bcache, bids[i]) == 0);
+        }
+        assert(st_block_cache_trim(bcache) >= 0);
+    }
+    assert(pthread_join(pt, NULL) == 0);
+    if (rargs.ret < 0 || st_block_cache_size(bcache) != 1) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
 
     safe_st_block_cache_destroy(bcache);
     return 0;
@@ -133,6 +674,18 @@ static int run_all_tests()
         ret = -1;
     }
 
+    if (unit_test_block_cache_threads() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_block_cache_keyed() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_block_cache_trim() != 0) {
+        ret = -1;
+    }
+
     return ret;
 }
 
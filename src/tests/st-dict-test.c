@@ -0,0 +1,909 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "st_dict.h"
+
+#define N 10000
+
+static int count_node(st_dict_node_t *p, void *arg)
+{
+    (*(int *)arg)++;
+    return 0;
+}
+
+static int set_node(st_dict_node_t *p, float data)
+{
+    p->uint1 = (unsigned int)data;
+    return 0;
+}
+
+static int check_dict(st_dict_t *dict, int n)
+{
+    st_dict_node_t node;
+    int i;
+
+    for (i = 1; i <= n; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        if (st_dict_seek(dict, &node, NULL) < 0) {
+            return -1;
+        }
+        if (node.uint1 != i) {
+            return -1;
+        }
+    }
+
+    node.sign1 = n + 1;
+    node.sign2 = (n + 1) * 7;
+    if (st_dict_seek(dict, &node, NULL) >= 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unit_test_dict_engine(st_dict_engine_t engine)
+{
+    static st_dict_node_t nodes[2 * N];
+    static int rets[2 * N];
+    st_dict_t *dict = NULL;
+    st_dict_t *dup = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    int ncase = 1;
+    int i, cnt;
+
+    fprintf(stderr, "  Testing st_dict with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = 0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dict = st_dict_create_ex(100, 100, NULL, NULL, true, &opt);
+    assert(dict != NULL);
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        if (st_dict_add(dict, &node, NULL) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (st_dict_add(dict, &node, NULL) >= 0 || dict->node_num != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (check_dict(dict, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    node.sign1 = 1;
+    node.sign2 = 7;
+    node.float1 = 11;
+    if (st_dict_update(dict, &node, NULL, set_node) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (st_dict_seek(dict, &node, NULL) < 0 || node.uint1 != 11) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    node.float1 = 1;
+    if (st_dict_update(dict, &node, NULL, set_node) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = 0; i < 2 * N; i++) {
+        nodes[i].sign1 = i + 1;
+        nodes[i].sign2 = (i + 1) * 7;
+        nodes[i].uint1 = 0;
+    }
+    nodes[2 * N - 1].sign2 = 0; // existing sign1 but absent key
+    if (st_dict_seek_batch(dict, nodes, 2 * N, NULL, rets) != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < 2 * N; i++) {
+        if ((i < N && (rets[i] != 0 || nodes[i].uint1 != i + 1))
+                || (i >= N && rets[i] != -1)) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dup = st_dict_dup(dict);
+    if (dup == NULL || check_dict(dup, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    cnt = 0;
+    if (st_dict_traverse(dup, count_node, &cnt) < 0 || cnt != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    cnt = 0;
+    if (st_dict_clear(dict, count_node, &cnt) < 0 || cnt != N
+            || dict->node_num != 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (check_dict(dict, 1) >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (check_dict(dup, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dup);
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dup);
+    return -1;
+}
+
+static int unit_test_dict_rehash()
+{
+    st_dict_t *dict = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    int ncase = 1;
+    int i, cnt;
+
+    fprintf(stderr, "  Testing st_dict rehash...\n");
+    opt.engine = ST_DICT_ENGINE_CHAIN;
+    opt.max_load_factor = 1.0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dict = st_dict_create_ex(16, 16, NULL, NULL, false, &opt);
+    assert(dict != NULL);
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        if (st_dict_add(dict, &node, NULL) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        if (i % 997 == 0 && check_dict(dict, i) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (check_dict(dict, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    cnt = 0;
+    if (st_dict_traverse(dict, count_node, &cnt) < 0 || cnt != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (dict->hash_num < N / 2) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = N; i > N / 2; i--) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        if (st_dict_delete(dict, &node, NULL) < 0 || node.uint1 != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (check_dict(dict, N / 2) < 0 || dict->node_num != N / 2) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = N / 2 + 1; i <= 2 * N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        if (st_dict_add(dict, &node, NULL) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (check_dict(dict, 2 * N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_dict_destroy(dict);
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    return -1;
+}
+
+static int unit_test_dict_delete(st_dict_engine_t engine)
+{
+    st_dict_t *dict = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    st_dict_id_t cur_index;
+    st_dict_id_t hash_num;
+    int ncase = 1;
+    int i, j, cnt;
+
+    fprintf(stderr, "  Testing st_dict delete with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = 0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    dict = st_dict_create_ex(N / 4, 100, NULL, NULL, true, &opt);
+    assert(dict != NULL);
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        assert(st_dict_add(dict, &node, NULL) == 0);
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = 1; i <= N; i += 2) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        if (st_dict_delete(dict, &node, NULL) < 0 || node.uint1 != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        if (st_dict_delete(dict, &node, NULL) >= 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        if ((st_dict_seek(dict, &node, NULL) == 0) != (i % 2 == 0)) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    cnt = 0;
+    if (dict->node_num != N / 2
+            || st_dict_traverse(dict, count_node, &cnt) < 0
+            || cnt != N / 2) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    cur_index = dict->cur_index;
+    hash_num = dict->hash_num;
+    for (j = 0; j < 10; j++) {
+        for (i = 1; i <= N; i += 2) {
+            node.sign1 = i;
+            node.sign2 = i * 7;
+            node.uint1 = i;
+            if (st_dict_add(dict, &node, NULL) < 0) {
+                fprintf(stderr, "Failed\n");
+                goto ERR;
+            }
+        }
+        if (check_dict(dict, N) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        for (i = 1; i <= N; i += 2) {
+            node.sign1 = i;
+            node.sign2 = i * 7;
+            if (st_dict_delete(dict, &node, NULL) < 0) {
+                fprintf(stderr, "Failed\n");
+                goto ERR;
+            }
+        }
+    }
+    if (dict->cur_index > cur_index || dict->hash_num > hash_num) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    cnt = 0;
+    if (st_dict_clear(dict, count_node, &cnt) < 0 || cnt != N / 2
+            || dict->node_num != 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        if (st_dict_add(dict, &node, NULL) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (check_dict(dict, N) < 0 || dict->cur_index > cur_index) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_dict_destroy(dict);
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    return -1;
+}
+
+static int unit_test_dict_save(st_dict_engine_t engine)
+{
+    char fname[] = "/tmp/st-dict-test.XXXXXX";
+    st_dict_t *dict = NULL;
+    st_dict_t *dict2 = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int i, fd;
+
+    fprintf(stderr, "  Testing st_dict save with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = 0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    dict = st_dict_create_ex(N / 4, 100, NULL, NULL, false, &opt);
+    assert(dict != NULL);
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        assert(st_dict_add(dict, &node, NULL) == 0);
+    }
+    fd = mkstemp(fname);
+    assert(fd >= 0);
+    fp = fdopen(fd, "w+");
+    assert(fp != NULL);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    if (st_dict_save(dict, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    dict2 = st_dict_load_from_bin(fp);
+    if (dict2 == NULL || dict2->hash_func != dict->hash_func
+            || check_dict(dict2, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (st_dict_add(dict2, &node, NULL) >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    node.sign1 = N + 1;
+    node.sign2 = (N + 1) * 7;
+    node.uint1 = N + 1;
+    if (st_dict_add(dict2, &node, NULL) < 0 || check_dict(dict2, N + 1) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_dict_destroy(dict2);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    safe_fclose(fp);
+    dict2 = st_dict_mmap(fname);
+    if (dict2 == NULL || check_dict(dict2, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    if (st_dict_add(dict2, &node, NULL) >= 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    (void)unlink(fname);
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dict2);
+    return 0;
+
+ERR:
+    safe_fclose(fp);
+    (void)unlink(fname);
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dict2);
+    return -1;
+}
+
+static int count_node_atomic(st_dict_node_t *p, void *arg)
+{
+    __atomic_fetch_add((int *)arg, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int unit_test_dict_bulk(st_dict_engine_t engine)
+{
+    static st_dict_node_t nodes[2 * N];
+    st_dict_t *dict = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    int ncase = 1;
+    int i, cnt;
+
+    fprintf(stderr, "  Testing st_dict bulk with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = (engine == ST_DICT_ENGINE_CHAIN) ? 1.0 : 0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dict = st_dict_create_ex(16, 16, NULL, NULL, false, &opt);
+    assert(dict != NULL);
+    for (i = 1; i <= 100; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        assert(st_dict_add(dict, &node, NULL) == 0);
+    }
+    // every key twice, some already in dict, and an empty node
+    for (i = 0; i < 2 * N; i++) {
+        nodes[i].sign1 = i % N + 1;
+        nodes[i].sign2 = (i % N + 1) * 7;
+        nodes[i].uint1 = i % N + 1;
+    }
+    nodes[N].sign1 = 0;
+    nodes[N].sign2 = 0;
+    if (st_dict_build_bulk(dict, nodes, 2 * N, 4) != N - 100
+            || dict->node_num != N || check_dict(dict, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    cnt = 0;
+    if (st_dict_traverse_parallel(dict, 4, count_node_atomic, &cnt) < 0
+            || cnt != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    node.sign1 = N + 1;
+    node.sign2 = (N + 1) * 7;
+    node.uint1 = N + 1;
+    if (st_dict_add(dict, &node, NULL) < 0 || check_dict(dict, N + 1) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_dict_destroy(dict);
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    return -1;
+}
+
+static int unit_test_dict_hash(st_dict_engine_t engine)
+{
+    st_dict_hash_fun_t funcs[] = {
+        st_dict_hash_fmix64,
+        st_dict_hash_xxh3,
+        st_dict_hash_wyhash,
+    };
+    st_dict_id_t hist[8];
+    st_dict_id_t sum;
+    st_dict_t *dict = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    int ncase = 1;
+    int i, f;
+
+    fprintf(stderr, "  Testing st_dict hash with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = (engine == ST_DICT_ENGINE_CHAIN) ? 1.0 : 0;
+    opt.concurrent = false;
+    opt.value_size = 0;
+    for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+        /*****************************************/
+        fprintf(stderr, "    Case %d...", ncase++);
+        dict = st_dict_create_ex(N, N, funcs[f], NULL, false, &opt);
+        assert(dict != NULL);
+        for (i = 1; i <= N; i++) {
+            node.sign1 = i;
+            node.sign2 = i * 7;
+            node.uint1 = i;
+            assert(st_dict_add(dict, &node, NULL) == 0);
+        }
+        if (check_dict(dict, N) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        // sequential keys must not pile up in a few buckets
+        if (st_dict_chain_hist(dict, hist, 8) >= 8) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        sum = 0;
+        for (i = 0; i < 8; i++) {
+            sum += hist[i];
+        }
+        if (sum != ((engine == ST_DICT_ENGINE_CHAIN) ? dict->hash_num : N)) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        fprintf(stderr, "Success\n");
+        safe_st_dict_destroy(dict);
+    }
+
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    return -1;
+}
+
+typedef struct _value_t_ {
+    unsigned long long id;
+    char name[32];
+} value_t;
+
+static void set_value(st_dict_node_t *node, int i)
+{
+    value_t *v = (value_t *)st_dict_node_value(node);
+
+    node->sign1 = i;
+    node->sign2 = i * 7;
+    node->uint1 = i;
+    v->id = i * 3ULL;
+    snprintf(v->name, sizeof(v->name), "v%d", i);
+}
+
+static int check_value(st_dict_t *dict, int i)
+{
+    char buf[128] __attribute__((aligned(16)));
+    st_dict_node_t *node = (st_dict_node_t *)buf;
+    st_dict_node_t *found;
+    value_t *v;
+    char name[32];
+
+    memset(buf, 0, sizeof(buf));
+    node->sign1 = i;
+    node->sign2 = i * 7;
+    found = st_dict_find(dict, node, NULL);
+    if (found == NULL || ((uintptr_t)found % 64) != 0) {
+        return -1;
+    }
+    snprintf(name, sizeof(name), "v%d", i);
+    v = (value_t *)st_dict_node_value(found);
+    if (found->uint1 != i || v->id != i * 3ULL || strcmp(v->name, name) != 0) {
+        return -1;
+    }
+
+    if (st_dict_seek(dict, node, NULL) < 0) {
+        return -1;
+    }
+    v = (value_t *)st_dict_node_value(node);
+    if (node->uint1 != i || v->id != i * 3ULL || strcmp(v->name, name) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unit_test_dict_value(st_dict_engine_t engine)
+{
+    char buf[128] __attribute__((aligned(16)));
+    st_dict_node_t *node = (st_dict_node_t *)buf;
+    st_dict_t *dict = NULL;
+    st_dict_t *dict2 = NULL;
+    st_dict_opt_t opt;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int i;
+
+    fprintf(stderr, "  Testing st_dict value with engine[%d]...\n", engine);
+    opt.engine = engine;
+    opt.max_load_factor = (engine == ST_DICT_ENGINE_CHAIN) ? 1.0 : 0;
+    opt.concurrent = false;
+    opt.value_size = sizeof(value_t);
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dict = st_dict_create_ex(16, 16, NULL, NULL, false, &opt);
+    assert(dict != NULL);
+    if (dict->node_size != 64) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 1; i <= N; i++) {
+        set_value(node, i);
+        if (st_dict_add(dict, node, NULL) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    for (i = 1; i <= N; i++) {
+        if (check_value(dict, i) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (i = 1; i <= N; i += 2) {
+        memset(buf, 0, sizeof(buf));
+        node->sign1 = i;
+        node->sign2 = i * 7;
+        if (st_dict_delete(dict, node, NULL) < 0
+                || ((value_t *)st_dict_node_value(node))->id != i * 3ULL) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    for (i = 2; i <= N; i += 2) {
+        if (check_value(dict, i) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    fp = tmpfile();
+    assert(fp != NULL);
+    if (st_dict_save(dict, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    dict2 = st_dict_load_from_bin(fp);
+    if (dict2 == NULL || dict2->value_size != sizeof(value_t)) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 2; i <= N; i += 2) {
+        if (check_value(dict2, i) < 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_fclose(fp);
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dict2);
+    return 0;
+
+ERR:
+    safe_fclose(fp);
+    safe_st_dict_destroy(dict);
+    safe_st_dict_destroy(dict2);
+    return -1;
+}
+
+#define NUM_READERS 4
+
+typedef struct _reader_args_t_ {
+    st_dict_t *dict;
+    int *num_added;
+    int ret;
+} reader_args_t;
+
+static void* reader(void *args)
+{
+    reader_args_t *r = (reader_args_t *)args;
+    st_dict_node_t node;
+    int n, i;
+
+    do {
+        n = __atomic_load_n(r->num_added, __ATOMIC_ACQUIRE);
+        for (i = 1; i <= n; i++) {
+            node.sign1 = i;
+            node.sign2 = i * 7;
+            if (st_dict_seek(r->dict, &node, NULL) < 0 || node.uint1 != i) {
+                r->ret = -1;
+                return NULL;
+            }
+        }
+    } while (n < N);
+
+    r->ret = 0;
+    return NULL;
+}
+
+static int unit_test_dict_concurrent()
+{
+    st_dict_t *dict = NULL;
+    st_dict_opt_t opt;
+    st_dict_node_t node;
+    pthread_t pts[NUM_READERS];
+    reader_args_t args[NUM_READERS];
+    int num_added = 0;
+    int ncase = 1;
+    int i;
+
+    fprintf(stderr, "  Testing st_dict concurrent...\n");
+    opt.engine = ST_DICT_ENGINE_CHAIN;
+    opt.max_load_factor = 0;
+    opt.concurrent = true;
+    opt.value_size = 0;
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    dict = st_dict_create_ex(N / 8, 16, NULL, NULL, false, &opt);
+    assert(dict != NULL);
+    for (i = 0; i < NUM_READERS; i++) {
+        args[i].dict = dict;
+        args[i].num_added = &num_added;
+        args[i].ret = -1;
+        assert(pthread_create(pts + i, NULL, reader, args + i) == 0);
+    }
+    for (i = 1; i <= N; i++) {
+        node.sign1 = i;
+        node.sign2 = i * 7;
+        node.uint1 = i;
+        assert(st_dict_add(dict, &node, NULL) == 0);
+        __atomic_store_n(&num_added, i, __ATOMIC_RELEASE);
+    }
+    for (i = 0; i < NUM_READERS; i++) {
+        assert(pthread_join(pts[i], NULL) == 0);
+        if (args[i].ret != 0) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (dict->retired_num <= 0 || st_dict_reclaim(dict) < 0
+            || check_dict(dict, N) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_dict_destroy(dict);
+    return 0;
+
+ERR:
+    safe_st_dict_destroy(dict);
+    return -1;
+}
+
+static int run_all_tests()
+{
+    int ret = 0;
+
+    if (unit_test_dict_engine(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_engine(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_rehash() != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_delete(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_delete(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_bulk(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_bulk(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_hash(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_hash(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_value(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_value(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_save(ST_DICT_ENGINE_CHAIN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_save(ST_DICT_ENGINE_OPEN) != 0) {
+        ret = -1;
+    }
+
+    if (unit_test_dict_concurrent() != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret;
+
+    fprintf(stderr, "Start testing...\n");
+    ret = run_all_tests();
+    if (ret != 0) {
+        fprintf(stderr, "Tests failed.\n");
+    } else {
+        fprintf(stderr, "Tests succeeded.\n");
+    }
+
+    return ret;
+}
@@ -0,0 +1,294 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Wang Jian
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "st_io.h"
+#include "st_trie.h"
+
+static const char *words[] = {
+    "a", "ab", "abc", "abd", "b", "ba", "bcd", "hello", "help", "he",
+    "\xe4\xb8\xad", "\xe4\xb8\xad\xe5\x9b\xbd", "zzz",
+};
+
+#define WORD_NUM (int)(sizeof(words) / sizeof(words[0]))
+#define N 20000
+
+static int collect(int id, void *args)
+{
+    int *ids = (int *)args;
+
+    ids[++ids[0]] = id;
+    return 0;
+}
+
+static int check_words(st_trie_t *trie, st_alphabet_t *alphabet)
+{
+    int ids[WORD_NUM + 1];
+    int lens[WORD_NUM];
+    int len;
+    int i;
+
+    for (i = 0; i < WORD_NUM; i++) {
+        if (st_trie_find(trie, words[i], strlen(words[i])) != i) {
+            return -1;
+        }
+    }
+    if (st_trie_find(trie, "abe", 3) >= 0 || st_trie_find(trie, "hel", 3) >= 0) {
+        return -1;
+    }
+
+    // "abcx" -> "abc", "hex" -> "he", "xyz" -> none
+    if (st_trie_longest_match(trie, "abcx", 4, &len) != 2 || len != 3) {
+        return -1;
+    }
+    if (st_trie_longest_match(trie, "hex", 3, &len) != 9 || len != 2) {
+        return -1;
+    }
+    if (st_trie_longest_match(trie, "xyz", 3, &len) >= 0) {
+        return -1;
+    }
+    if (st_trie_longest_match(trie, "\xe4\xb8\xad\xe5\x9b\xbd\xe4", 7,
+                &len) != 11 || len != 6) {
+        return -1;
+    }
+
+    if (st_trie_common_prefix(trie, "abcd", 4, ids, lens, WORD_NUM) != 3
+            || ids[0] != 0 || ids[1] != 1 || ids[2] != 2 || lens[2] != 3) {
+        return -1;
+    }
+    if (st_trie_common_prefix(trie, "abcd", 4, ids, lens, 2) != 2) {
+        return -1;
+    }
+
+    // in byte order
+    ids[0] = 0;
+    if (st_trie_enumerate(trie, "ab", 2, collect, ids) != 3 || ids[0] != 3
+            || ids[1] != 1 || ids[2] != 2 || ids[3] != 3) {
+        return -1;
+    }
+    ids[0] = 0;
+    if (st_trie_enumerate(trie, "he", 2, collect, ids) != 3
+            || ids[1] != 9 || ids[2] != 7 || ids[3] != 8) {
+        return -1;
+    }
+    if (st_trie_enumerate(trie, "q", 1, NULL, NULL) != 0
+            || st_trie_enumerate(trie, NULL, 0, NULL, NULL) != WORD_NUM) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int unit_test_trie()
+{
+    char fname[] = "/tmp/st-trie-test.XXXXXX";
+    char buf[MAX_SYM_LEN];
+    st_alphabet_t *alphabet = NULL;
+    st_alphabet_t *alphabet2 = NULL;
+    st_trie_t *trie = NULL;
+    st_trie_t *trie2 = NULL;
+    st_trie_unit_t unit;
+    FILE *fp = NULL;
+    int ncase = 1;
+    int len;
+    int fd;
+    int i;
+
+    fprintf(stderr, "  Testing st_trie...\n");
+    alphabet = st_alphabet_create(WORD_NUM);
+    assert(alphabet != NULL);
+    for (i = 0; i < WORD_NUM; i++) {
+        assert(st_alphabet_add_label(alphabet, words[i]) == i);
+    }
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    trie = st_trie_build(alphabet);
+    if (trie == NULL || check_words(trie, alphabet) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    fd = mkstemp(fname);
+    assert(fd >= 0);
+    fp = fdopen(fd, "w+");
+    assert(fp != NULL);
+    if (st_alphabet_save_bin(alphabet, fp) < 0 || st_trie_save(trie, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    rewind(fp);
+    alphabet2 = st_alphabet_load_from_bin(fp);
+    trie2 = st_trie_load_from_bin(fp);
+    if (alphabet2 == NULL || trie2 == NULL
+            || check_words(trie2, alphabet2) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_trie_destroy(trie2);
+    safe_st_alphabet_destroy(alphabet2);
+
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 0) == 0);
+    if (st_trie_save(trie, fp) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    trie2 = st_trie_mmap(fname);
+    if (trie2 == NULL || check_words(trie2, alphabet) < 0) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_trie_destroy(trie2);
+
+    // a label id out of range is rejected like the loader does
+    unit = trie->units[trie->size - 1];
+    trie->units[trie->size - 1].base = -WORD_NUM - 1;
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 0) == 0);
+    if (st_trie_save(trie, fp) < 0 || fflush(fp) != 0
+            || st_trie_mmap(fname) != NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    trie->units[trie->size - 1] = unit;
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_trie_destroy(trie);
+    safe_st_alphabet_destroy(alphabet);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    alphabet = st_alphabet_create(N);
+    assert(alphabet != NULL);
+    for (i = 0; i < N; i++) {
+        snprintf(buf, sizeof(buf), "%d", i * 7);
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    trie = st_trie_build(alphabet);
+    if (trie == NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < N; i++) {
+        snprintf(buf, sizeof(buf), "%d", i * 7);
+        if (st_trie_find(trie, buf, strlen(buf)) != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+        // one digit more is never a label prefix of the longest match
+        strcat(buf, "x");
+        if (st_trie_longest_match(trie, buf, strlen(buf), &len) != i
+                || len != strlen(buf) - 1) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    if (st_trie_enumerate(trie, NULL, 0, NULL, NULL) != N) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    safe_st_trie_destroy(trie);
+    safe_st_alphabet_destroy(alphabet);
+    fprintf(stderr, "Success\n");
+
+    /*****************************************/
+    fprintf(stderr, "    Case %d...", ncase++);
+    // longest labels, split only at their last bytes
+    alphabet = st_alphabet_create(WORD_NUM);
+    assert(alphabet != NULL);
+    memset(buf, 'x', sizeof(buf));
+    buf[MAX_SYM_LEN - 1] = 0;
+    for (i = 0; i < WORD_NUM; i++) {
+        buf[MAX_SYM_LEN - 3] = 'a' + i / 4;
+        buf[MAX_SYM_LEN - 2] = 'a' + i % 4;
+        assert(st_alphabet_add_label(alphabet, buf) == i);
+    }
+    trie = st_trie_build(alphabet);
+    if (trie == NULL) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    for (i = 0; i < WORD_NUM; i++) {
+        buf[MAX_SYM_LEN - 3] = 'a' + i / 4;
+        buf[MAX_SYM_LEN - 2] = 'a' + i % 4;
+        if (st_trie_find(trie, buf, MAX_SYM_LEN - 1) != i) {
+            fprintf(stderr, "Failed\n");
+            goto ERR;
+        }
+    }
+    buf[MAX_SYM_LEN - 3] = 'a';
+    if (st_trie_enumerate(trie, buf, MAX_SYM_LEN - 2, NULL, NULL) != 4) {
+        fprintf(stderr, "Failed\n");
+        goto ERR;
+    }
+    fprintf(stderr, "Success\n");
+
+    safe_st_trie_destroy(trie);
+    safe_st_alphabet_destroy(alphabet);
+    return 0;
+
+ERR:
+    safe_st_fclose(fp);
+    unlink(fname);
+    safe_st_trie_destroy(trie);
+    safe_st_trie_destroy(trie2);
+    safe_st_alphabet_destroy(alphabet);
+    safe_st_alphabet_destroy(alphabet2);
+    return -1;
+}
+
+static int run_all_tests()
+{
+    int ret = 0;
+
+    if (unit_test_trie() != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret;
+
+    fprintf(stderr, "Start testing...\n");
+    ret = run_all_tests();
+    if (ret != 0) {
+        fprintf(stderr, "Tests failed.\n");
+    } else {
+        fprintf(stderr, "Tests succeeded.\n");
+    }
+
+    return ret;
+}
@@ -108,6 +108,58 @@ static int unit_test_permutation()
     return 0;
 }
 
+typedef struct _sum_args_t_ {
+    int from;
+    int to;
+    long sum;
+} sum_args_t;
+
+static void* sum_thread(void *args)
+{
+    sum_args_t *sargs;
+    int i;
+
+    sargs = (sum_args_t *)args;
+    sargs->sum = 0;
+    for (i = sargs->from; i < sargs->to; i++) {
+        sargs->sum += i;
+    }
+
+    return NULL;
+}
+
+static int unit_test_run_threads()
+{
+    sum_args_t sargs[4];
+    long sum;
+    int n = 1000;
+    int nthreads = 4;
+
+    int ncase = 0;
+
+    int t;
+
+    fprintf(stderr, "  Testing run_threads...\n");
+    fprintf(stderr, "    Case %d...", ncase++);
+    for (t = 0; t < nthreads; t++) {
+        sargs[t].from = n * t / nthreads;
+        sargs[t].to = n * (t + 1) / nthreads;
+    }
+    st_run_threads(sum_thread, sargs, sizeof(sargs[0]), nthreads);
+
+    sum = 0;
+    for (t = 0; t < nthreads; t++) {
+        sum += sargs[t].sum;
+    }
+    if (sum != (long)n * (n - 1) / 2) {
+        fprintf(stderr, "Failed.\n");
+        return -1;
+    }
+    fprintf(stderr, "Passed.\n");
+
+    return 0;
+}
+
 static int run_all_tests()
 {
     int ret = 0;
@@ -116,6 +168,10 @@ static int run_all_tests()
         ret = -1;
     }
 
+    if (unit_test_run_threads() != 0) {
+        ret = -1;
+    }
+
     return ret;
 }
 